@@ -8,61 +8,203 @@
 #include <math.h>
 #include <strings.h>
 #include <stdbool.h>
-
-#define MAX_CACHE_SIZE 10240
-#define CACHE_MISS_DELAY 10 // 10 cycle cache miss penalty
-#define MAX_STAGES 5
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <errno.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if !defined(IPLC_SIM_NO_SIMD) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+
+#define CACHE_MISS_DELAY 10 // 10 cycle cache miss penalty, the default memory latency
+#define MAX_STAGES 32     // deepest pipeline, see -depth
+#define PIPELINE_DEPTH 5  // the classic FETCH, DECODE, ALU, MEM, WRITEBACK
+#define MAX_WIDTH 4       // widest issue, see -width
+#define OOO_ROB_SIZE 64      // default reorder buffer entries of the out-of-order core
+#define OOO_IQ_SIZE 32       // ... issue queue entries
+#define OOO_LSQ_SIZE 16      // ... load/store queue entries
+#define OOO_MAX_ENTRIES 4096 // largest reorder buffer, see -rob
+#define OOO_FRONTEND 2       // decode and rename, the cycles between fetch and dispatch
+#define OOO_ISSUE_SLOTS (1 << 16) // cycles past dispatch the issue width is kept track of for, a power of two
+#define SAMPLE_WINDOW 1000 // default instructions measured in each sample, see -sample
+#define SAMPLE_WARMUP 2000 // ... run in detail ahead of it to warm the pipeline up
+#define SAMPLE_MIN_SAMPLES 30 // fewer and the sampling report warns the estimate is shaky
+#define CACHE_MAX_LEVELS 8  // L1 and up to seven levels below it
+#define PREDICTOR_BITS 12     // default index bits of the branch predictor tables
+#define PREDICTOR_MAX_BITS 24
+
+// Cache layout
+#define CACHE_LINE_BYTES 64 // host cache line, no set's metadata straddles one
+#define CACHE_TAG_LANES 8   // tags are compared 8 at a time, larger sets are padded to this
+#define CACHE_MAX_INDEX 28
+#define CACHE_LAZY_BYTES (1 << 20) // caches this big are zeroed by handing their pages back
+#define CACHE_MAX_ASSOC 64  // one bit per way in the valid mask
+
+// Binary trace format
+#define TRACE_MAGIC "IPLCTRC1"
+#define TRACE_VERSION 1
+#define TRACE_MAX_MNEMONICS 256
+#define TRACE_MNEMONIC_LEN 16
+#define TRACE_BUFFER_RECORDS 4096
+
+// Checkpoints, see checkpoint_header_t
+#define CHECKPOINT_MAGIC "IPLCCKPT"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_MAX_BLOCKS 32 // caches, predictor tables and out-of-order core tables
+#define CHECKPOINT_TRACE_PROBE 4096 // bytes at the start of the trace a checkpoint knows it by
+
+// Sweeps, see run_sweep()
+#define SWEEP_MAX_AXES 16
+#define SWEEP_MAX_VALUES 256
+#define SWEEP_MAX_POINTS (1 << 20)
+#define SWEEP_VALUE_LEN 16
+
+// -bench-lookup
+#define BENCH_LOOKUPS (1 << 24)
+
+// -bench and -gen
+#define BENCH_RECORDS 1000000
+#define GENERATE_FOOTPRINT (1 << 20) // bytes of data a synthetic trace touches
+#define GENERATE_STRIDE 64
+
+// Event tracing, build with -DIPLC_SIM_NO_EVENTS to compile every event out
+#define EVENT_RING_SIZE 4096 // events between the simulator and its sink, a power of two
+#define EVENT_BIT(type) (1u << (type))
+
+// -hotspots
+#define ATTRIBUTION_PCS 1024 // instructions the table starts with room for, a power of two
+
+// -interval
+#define INTERVAL_RING_SIZE 256 // snapshots between the simulator and the writer, a power of two
+
+// -profile, build with -DIPLC_SIM_NO_PROFILE to compile the hooks out
+#define PROFILE_DEPTH 16 // phases that can be entered inside one another
 
 
 
 //****** Functions *****//
 // Simulator Functions
-void iplc_sim_init(int index, int blocksize, int assoc);
-void iplc_sim_close();
+struct sim;
+struct sim_config;
+struct sim* iplc_sim_create(const struct sim_config *config, FILE *out);
+void iplc_sim_init(struct sim *sim);
+void iplc_sim_reset(struct sim *sim);
+void iplc_sim_effective_config(const struct sim *sim, struct sim_config *config);
+void iplc_sim_destroy(struct sim *sim);
+
+// Event Tracing Functions
+void iplc_sim_events_open(struct sim *sim);
+void iplc_sim_events_close(struct sim *sim);
 
 // Cache Simulator Functions
-void iplc_sim_LRU_replace_on_miss(int index, int tag);
-void iplc_sim_LRU_update_on_hit(int index, int assoc);
-int iplc_sim_trap_address(unsigned int address);
+struct cache;
+struct cache_victim;
+void iplc_sim_replace_on_miss(struct cache *cache, int index, int tag, unsigned int address, struct cache_victim *victim);
+void iplc_sim_update_on_hit(struct cache *cache, int index, int assoc_entry);
+int iplc_sim_cache_lookup(struct cache *cache, unsigned int address, struct cache_victim *victim);
+int iplc_sim_cache_invalidate(struct cache *cache, unsigned int address);
+int iplc_sim_trap_address(struct sim *sim, unsigned int address);
+int iplc_sim_trap_data_address(struct sim *sim, unsigned int pc, unsigned int address);
 
 // Pipeline Functions
-unsigned int iplc_sim_parse_reg(char *reg_str);
-void iplc_sim_parse_instruction(char *buffer);
-void iplc_sim_push_pipeline_stage();
-void iplc_sim_process_pipeline_rtype(char *instruction, int dest_reg, int reg1, int reg2_or_constant);
-void iplc_sim_process_pipeline_lw(int dest_reg, int base_reg, unsigned int data_address);
-void iplc_sim_process_pipeline_sw(int src_reg, int base_reg, unsigned int data_address);
-void iplc_sim_process_pipeline_branch(int reg1, int reg2);
-void iplc_sim_process_pipeline_jump();
-void iplc_sim_process_pipeline_syscall();
-void iplc_sim_process_pipeline_nop();
+void iplc_sim_parse_instruction(struct sim *sim, char *buffer);
+void iplc_sim_push_pipeline_stage(struct sim *sim);
+void iplc_sim_advance_pipeline(struct sim *sim, int pushes);
+void iplc_sim_process_pipeline_rtype(struct sim *sim, const char *instruction, int dest_reg, int reg1, int reg2_or_constant);
+void iplc_sim_process_pipeline_lw(struct sim *sim, int dest_reg, int base_reg, unsigned int data_address);
+void iplc_sim_process_pipeline_sw(struct sim *sim, int src_reg, int base_reg, unsigned int data_address);
+void iplc_sim_process_pipeline_branch(struct sim *sim, int reg1, int reg2);
+void iplc_sim_process_pipeline_jump(struct sim *sim, const char *instruction, int reg1);
+void iplc_sim_process_pipeline_syscall(struct sim *sim);
+void iplc_sim_process_pipeline_nop(struct sim *sim);
+
+// Trace Functions
+struct trace_record;
+struct trace_mnemonics;
+struct trace_reader;
+void iplc_sim_decode_line(const char *line, const char *end, struct trace_record *rec, struct trace_mnemonics *mnemonics);
+void iplc_sim_decode_instruction(const char *buffer, struct trace_record *rec, struct trace_mnemonics *mnemonics);
+void iplc_sim_process_record(struct sim *sim, const struct trace_record *rec, const struct trace_mnemonics *mnemonics);
+long iplc_sim_trace_convert(struct trace_reader *trace, FILE *out);
+struct trace_reader* iplc_sim_trace_open(const char *path);
+struct trace_reader* iplc_sim_trace_attach(FILE *file);
+struct trace_reader* iplc_sim_trace_clone(struct trace_reader *trace);
+int iplc_sim_trace_next(struct trace_reader *trace, struct trace_record *rec);
+void iplc_sim_trace_rewind(struct trace_reader *trace);
+off_t iplc_sim_trace_tell(struct trace_reader *trace);
+void iplc_sim_trace_seek(struct trace_reader *trace, off_t offset);
+void iplc_sim_trace_close(struct trace_reader *trace);
+int iplc_sim_trace_pattern(const char *name);
+long iplc_sim_trace_generate(FILE *out, int pattern, long records, long footprint, int stride);
+
+// Checkpoint Functions
+void iplc_sim_checkpoint_save(struct sim *sim, struct trace_reader *trace, const char *path);
+void iplc_sim_checkpoint_restore(struct sim *sim, struct trace_reader *trace, const char *path);
+
+// Out-of-Order Core Functions
+void iplc_sim_ooo_init(struct sim *sim);
+void iplc_sim_ooo_reset(struct sim *sim);
+void iplc_sim_ooo_free(struct sim *sim);
+void iplc_sim_ooo_record(struct sim *sim, const struct trace_record *rec, const char *instruction, int instruction_hit);
+void iplc_sim_ooo_drain(struct sim *sim);
+
+// Sampled Simulation Functions
+void iplc_sim_sample_close(struct sim *sim);
+
+// Miss Attribution Functions
+void iplc_sim_attribution_init(struct sim *sim);
+void iplc_sim_attribution_reset(struct sim *sim);
+void iplc_sim_attribution_free(struct sim *sim);
+void iplc_sim_attribute_miss(struct sim *sim, unsigned int address, int cycles);
+void iplc_sim_attribution_report(struct sim *sim);
+
+// Interval Statistics Functions
+void iplc_sim_interval_open(struct sim *sim);
+void iplc_sim_interval_start(struct sim *sim);
+void iplc_sim_interval_check(struct sim *sim);
+void iplc_sim_interval_close(struct sim *sim);
+
+// Profiling Functions
+struct profile* iplc_sim_profile_start(void);
+void iplc_sim_profile_report(struct profile *profile, FILE *out);
 
 // Outout performance results
-void iplc_sim_finalize();
+void iplc_sim_finalize(struct sim *sim);
+double iplc_sim_cpi(const struct sim *sim);
 
 
 
 //*****Variables and Data Structures*****//
-typedef struct cache_line {
-    /* Your data structures for implementing your cache should include:
-       a valid bit
-       a tag
-       a method for handling varying levels of associativity
-       a method for selecting which item in the cache is going to be replaced */
-    char* valid_bit;
-    int* tag;
-    int* age; // Counter for time since last access
-} cache_line_t;
-
-typedef struct pa_run {
-    /* Structure to hold the performance analysis sims */
-    int index;
-    int blocksize;
-    int associativity;
-    int branch_pred;
-    double cpi;
-    double cmr; // cache miss rate
-} pa_run_t;
+/*  The whole cache is one page aligned allocation with a fixed size block
+    per set, so everything a lookup touches for a set sits together:
+        uint64_t valid            bit i is the valid bit of way i
+        uint32_t tag[cache_ways]  cache_ways is assoc, padded to CACHE_TAG_LANES
+                                  once there are that many ways
+        uint32_t line[cache_ways] address >> blockoffsetbits of each way, only when
+                                  the hierarchy needs to know what was evicted
+        uint8_t  repl[]           replacement policy state, its size depends on the policy
+    The padding tags are never valid, so the tag compare can always work on
+    whole groups of CACHE_TAG_LANES ways. A block is a power of two bytes up
+    to CACHE_LINE_BYTES and whole host cache lines past that, so a direct
+    mapped set takes 16 bytes and an 8-way LRU set one host cache line. */
+typedef struct cache_set {
+    uint64_t* valid;
+    uint32_t* tag;
+    uint32_t* line; // NULL when the cache doesn't track line addresses
+    uint8_t* repl;
+} cache_set_t;
 
 // Stats for the various instructions
 typedef struct instruction_stats {
@@ -74,34 +216,120 @@ typedef struct instruction_stats {
     int syscall;
     int nop;
 } inst_stats_t;
-inst_stats_t inst_stats = {0,0,0,0,0,0,0};
-
-// Cache Variables
-cache_line_t* cache = NULL;
-int cache_index = 0;
-int cache_blocksize = 0;
-int cache_blockoffsetbits = 0;
-int cache_assoc = 0;
-
-// Cache Statistics
-long cache_miss = 0;
-long cache_access = 0;
-long cache_hit = 0;
-
-char instruction[16];
-char reg1[16];
-char reg2[16];
-char offsetwithreg[16];
-unsigned int data_address = 0;
-unsigned int instruction_address = 0;
-unsigned int pipeline_cycles = 0;   // how many cycles did you pipeline consume
-unsigned int instruction_count = 0; // home many real instructions ran thru the pipeline
-unsigned int branch_predict_taken = 0;
-unsigned int branch_count = 0;
-unsigned int correct_branch_predictions = 0;
-
-unsigned int debug = 0;
-unsigned int dump_pipeline = 1;
+
+// Where lw/sw data accesses go. With DCACHE_NONE they are not modelled at all
+enum data_cache_mode {DCACHE_NONE, DCACHE_SPLIT, DCACHE_UNIFIED, DCACHE_COUNT};
+
+// How the levels below L1 share lines with the levels above them
+enum inclusion_policy {INCLUSION_NINE, INCLUSION_INCLUSIVE, INCLUSION_EXCLUSIVE, INCLUSION_COUNT};
+
+/*  How results reach the instructions behind them. FWD_LEGACY is the
+    original load-use check, the others drive the register scoreboard:
+    FWD_FULL forwards EX->EX and MEM->EX, FWD_MEM only MEM->EX and with
+    FWD_NONE everything waits for the register file. */
+enum forwarding_mode {FWD_LEGACY, FWD_FULL, FWD_MEM, FWD_NONE, FWD_COUNT};
+
+// Cache replacement policies, see replacement_ops[]
+enum replacement_policy {REPL_LRU, REPL_TREE_PLRU, REPL_BIT_PLRU, REPL_FIFO, REPL_RANDOM, REPL_SRRIP, REPL_BRRIP,
+                         REPL_COUNT};
+
+// Branch predictors, see predictor_ops[]
+enum predictor_kind {PRED_STATIC, PRED_BIMODAL, PRED_GSHARE, PRED_TOURNAMENT, PRED_COUNT};
+
+// How instructions are timed: the in-order pipeline or the out-of-order core, see ooo_t
+enum core_model {CORE_INORDER, CORE_OOO, CORE_COUNT};
+
+// Functional units of the out-of-order core, each with its own latency
+enum fu_class {FU_ALU, FU_MUL, FU_DIV, FU_AGU, FU_BRANCH, FU_COUNT};
+
+// The counters of an -interval snapshot and of a -pa run's results, see iplc_sim_interval_totals()
+enum interval_count {INTERVAL_INSTRUCTIONS, INTERVAL_CYCLES, INTERVAL_FETCHES, INTERVAL_FETCH_MISSES,
+                     INTERVAL_DATA_ACCESSES, INTERVAL_DATA_MISSES, INTERVAL_BRANCHES, INTERVAL_MISPREDICTIONS,
+                     INTERVAL_FETCH_STALLS, INTERVAL_DATA_STALLS, INTERVAL_BRANCH_STALLS, INTERVAL_HAZARD_STALLS,
+                     INTERVAL_STRUCTURAL_STALLS, INTERVAL_COUNTS};
+
+// csv writes a line per interval with the rates worked out, binary writes the interval_t records
+enum interval_format {INTERVAL_CSV, INTERVAL_BINARY, INTERVAL_FORMAT_COUNT};
+
+// -results writes a JSON object per line or a CSV row for each run, as it finishes
+enum result_format {RESULT_JSON, RESULT_CSV, RESULT_FORMAT_COUNT};
+
+// What -pa and -sweep pick the best run by, the lowest score wins, see run_score()
+enum objective {OBJECTIVE_CPI_CMR, OBJECTIVE_CPI, OBJECTIVE_CMR, OBJECTIVE_DMR, OBJECTIVE_MPKI, OBJECTIVE_CYCLES,
+                OBJECTIVE_MISPREDICT, OBJECTIVE_COUNT};
+
+// One cache level below L1
+typedef struct cache_level {
+    int index;
+    int blocksize;
+    int assoc;
+    int latency;     // cycles to get a line from this level
+    int replacement; // enum replacement_policy
+} cache_level_t;
+
+// Everything that describes one simulation run
+typedef struct sim_config {
+    int index;
+    int blocksize;
+    int assoc;
+    int branch_predict_taken;
+    int replacement; // enum replacement_policy
+    uint64_t seed;   // seeds the random and bimodal RRIP replacement
+    int data_cache;  // enum data_cache_mode
+    int data_index;  // data cache geometry for DCACHE_SPLIT, 0 copies the instruction cache
+    int data_blocksize;
+    int data_assoc;
+    int levels;      // cache levels below L1, 0 puts memory right behind L1
+    cache_level_t level[CACHE_MAX_LEVELS - 1]; // level[0] is L2
+    int inclusion;   // enum inclusion_policy
+    int memory_latency; // 0 means CACHE_MISS_DELAY
+    int depth;          // pipeline stages, 0 means PIPELINE_DEPTH
+    int branch_stage;   // stage branches are resolved in, 0 means DECODE
+    int mem_stage;      // stage lw/sw access memory in, 0 means the one before WRITEBACK
+    int predictor;      // enum predictor_kind, PRED_STATIC follows branch_predict_taken
+    int predictor_bits; // index bits of the predictor tables, 0 means PREDICTOR_BITS
+    int history_bits;   // global/local history bits, 0 means predictor_bits
+    int btb_bits;       // index bits of the branch target buffer, 0 means targets are always known
+    int forwarding;     // enum forwarding_mode
+    int width;          // instructions per stage, 0 means 1
+    int mem_ports;      // lw/sw per stage when wider than 1, 0 means 1
+    int branch_units;   // branches and jumps per stage when wider than 1, 0 means 1
+    int core;           // enum core_model
+    int rob_size;       // reorder buffer entries, 0 means OOO_ROB_SIZE
+    int iq_size;        // issue queue entries, 0 means OOO_IQ_SIZE
+    int lsq_size;       // load/store queue entries, 0 means OOO_LSQ_SIZE
+    int fu_latency[FU_COUNT]; // cycles from issue to result, 0 means the unit's default
+    long sample_period; // instructions from one sample to the next, 0 times every instruction
+    long sample_window; // instructions measured in each sample, 0 means SAMPLE_WINDOW
+    long sample_warmup; // instructions timed but not measured ahead of each window, 0 means SAMPLE_WARMUP
+    unsigned int events;    // EVENT_BIT mask of what to trace, 0 means EVENTS_DEFAULT
+    int event_sink;         // enum event_sink
+    const char* event_file; // where the sink writes, NULL writes text to the report
+    int hotspots;           // instructions and sets the miss attribution reports, 0 keeps none
+    struct profile* profile; // where -profile charges the run, NULL if it isn't profiled
+    long interval;          // instructions from one interval snapshot to the next, 0 takes none
+    int interval_format;    // enum interval_format
+    const char* interval_file;
+} sim_config_t;
+
+typedef struct pa_run {
+    /* Structure to hold the performance analysis sims */
+    sim_config_t config;
+    char event_file[256]; // this run's own -eventfile
+    char interval_file[256]; // ... and -intervalfile
+    double cpi;
+    double cmr; // cache miss rate
+    inst_stats_t inst_stats;
+    uint64_t counts[INTERVAL_COUNTS]; // the run's totals
+} pa_run_t;
+
+// Where -results go, and what picks the best run
+typedef struct run_results {
+    FILE* file;    // NULL without -results
+    int format;    // enum result_format
+    int objective; // enum objective
+    long rows;     // written so far, the CSV header goes ahead of the first
+} run_results_t;
 
 enum instruction_type {NOP, RTYPE, LW, SW, BRANCH, JUMP, JAL, SYSCALL};
 
@@ -134,9 +362,33 @@ typedef struct jump {
     char instruction[16];
 } jump_t;
 
+/*  For the miss attribution: the misses of one instruction, kept in an open
+    addressing table with linear probing. An entry is free while misses is 0. */
+typedef struct pc_stats {
+    uint32_t address;
+    uint32_t misses;
+    uint64_t stall_cycles; // the cycles its misses took to service
+} pc_stats_t;
+
+typedef struct pc_table {
+    pc_stats_t* entries; // NULL unless -hotspots
+    uint32_t mask;       // entries - 1, a power of two
+    uint32_t count;      // entries in use
+} pc_table_t;
+
+// ... and the demand traffic of one L1 set
+typedef struct set_stats {
+    uint64_t access;
+    uint64_t miss;
+    uint64_t evict; // misses that pushed a valid line out
+} set_stats_t;
+
 typedef struct pipeline {
     enum instruction_type itype;
     unsigned int instruction_address;
+    uint32_t reads;      // registers read going into ALU, a bit per register ($0 never counts)
+    uint32_t reads_late; // registers read going into MEM, the data a sw stores
+    uint32_t writes;
     union {
         rtype_t   rtype;
         lw_t      lw;
@@ -147,541 +399,4713 @@ typedef struct pipeline {
     stage;
 } pipeline_t;
 
+/*  Stage positions of the classic 5 stage pipeline. A pipeline of any other
+    depth keeps FETCH first and WRITEBACK last and puts branch resolution
+    and memory access where sim_config_t says, ALU being right before MEM. */
 enum pipeline_stages {FETCH, DECODE, ALU, MEM, WRITEBACK};
 
-pipeline_t pipeline[MAX_STAGES];
+/*  One decoded trace line. The register fields follow the arguments of the
+    matching iplc_sim_process_pipeline_*() function:
+        RTYPE   dest_reg, reg1, reg2_or_constant
+        LW      dest_reg, reg1 = base reg, data_address
+        SW      dest_reg = src reg, reg1 = base reg, data_address
+        BRANCH  reg1, reg2_or_constant = reg2
+        JUMP    reg1 = the register jr and jalr jump to
+    mnemonic indexes the trace's mnemonic table. */
+typedef struct trace_record {
+    uint32_t instruction_address;
+    uint32_t data_address;
+    int32_t reg2_or_constant;
+    uint8_t itype;
+    uint8_t mnemonic;
+    int8_t dest_reg;
+    int8_t reg1;
+} trace_record_t;
+
+/*  Only name[] is stored in a binary trace, itype[] and operands[] are
+    filled in as the text decoder first meets each mnemonic. */
+typedef struct trace_mnemonics {
+    int count;
+    char name[TRACE_MAX_MNEMONICS][TRACE_MNEMONIC_LEN];
+    uint8_t itype[TRACE_MAX_MNEMONICS];    // enum instruction_type
+    uint8_t operands[TRACE_MAX_MNEMONICS]; // enum trace_operands
+} trace_mnemonics_t;
+
+/*  Binary trace file layout: this header, the full mnemonic table
+    (TRACE_MAX_MNEMONICS entries, unused ones zeroed), then record_count
+    trace_record_t entries. Everything is stored in host byte order. */
+typedef struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t mnemonic_count;
+    uint64_t record_count;
+} trace_header_t;
+
+#define TRACE_DATA_OFFSET (sizeof(trace_header_t) + TRACE_MAX_MNEMONICS * TRACE_MNEMONIC_LEN)
+
+// Locality of a synthetic trace, see iplc_sim_trace_generate()
+enum trace_pattern {PATTERN_STREAM, PATTERN_STRIDE, PATTERN_RANDOM, PATTERN_LOOP, PATTERN_CHASE, PATTERN_COUNT};
+
+/*  Reads either trace format, handing out one record at a time. Binary
+    traces are read with pread() from our own offset, text traces are mapped
+    and decoded straight out of the mapping, so clones of a reader can walk
+    the same file independently from different threads. Text that can't be
+    mapped (a pipe, say) is read a line at a time with getline(). */
+typedef struct trace_reader {
+    FILE* file;
+    int binary;
+    int shared;        // a clone, the file and mapping belong to another reader
+    off_t offset;      // next byte to read in a binary or mapped text trace
+    const char* text;  // the mapped text trace, NULL if it isn't mapped
+    size_t text_size;
+    char* line;        // getline() buffer for unmapped text
+    size_t line_size;
+    trace_mnemonics_t mnemonics;
+    trace_record_t records[TRACE_BUFFER_RECORDS];
+    size_t record_count; // records currently buffered
+    size_t record_pos;   // next buffered record to hand out
+    struct profile* profile; // charged for decoding text, NULL if it isn't profiled
+} trace_reader_t;
+
+// One cache, its sets live in a single allocation laid out as described at cache_set_t
+typedef struct cache {
+    uint8_t* sets;         // every set's metadata, set_bytes per set
+    size_t set_bytes;
+    size_t repl_offset;    // where the policy state sits in a set, after the tags and line addresses
+    int ways;              // assoc, rounded up to CACHE_TAG_LANES from that many ways on
+    int lines;             // the sets hold line addresses as well
+    const struct replacement_ops* replacement;
+    uint64_t rng;          // state of the random replacement policies
+    int index;
+    int blocksize;
+    int blockoffsetbits;
+    int assoc;
+    int latency;           // cycles to get a line from this cache when it is below L1
+
+    // Demand accesses that reached a level below L1
+    long access;
+    long hit;
+    long miss;
+
+    struct set_stats* set_stats; // a set's traffic for -hotspots, NULL unless it is on for this L1 cache
+    struct profile* profile;     // the simulator's, for the replacement policy's time
+} cache_t;
+
+// The line a fill pushed out of a cache, valid is 0 if the fill took a free way
+typedef struct cache_victim {
+    int valid;
+    unsigned int address;
+} cache_victim_t;
+
+/*  Branch predictor state. The tables hold 2-bit saturating counters that
+    predict taken from 2 up. bimodal indexes counters by the branch address
+    and gshare by the address xor the global history. tournament keeps a
+    local history per branch (local_history, indexed by address) that picks
+    one of its local counters, global counters indexed by the global history
+    and a chooser, also indexed by the global history, that picks global
+    from 2 up. The branch target buffer is direct mapped on the address. */
+typedef struct predictor {
+    const struct predictor_ops* ops;
+    int static_taken;    // what PRED_STATIC predicts
+    int bits;            // index bits of counters, or local_history for tournament
+    int history_bits;
+    uint32_t history;    // global history, the newest outcome in bit 0
+    uint8_t* counters;   // global counters for tournament
+    uint8_t* local;
+    uint32_t* local_history;
+    uint8_t* chooser;
+    int btb_bits;        // 0 without a branch target buffer
+    uint32_t* btb_tag;   // the branch address, 0 when the entry is empty
+    uint32_t* btb_target;
+
+    long predictions;
+    long correct;
+    long local_correct;  // how the two halves of tournament would have done alone
+    long global_correct;
+    long btb_lookups;
+    long btb_hits;
+    long mispredict_cycles;
+} predictor_t;
+
+/*  Out-of-order core timing. Instructions arrive in program order and each
+    one is timed through fetch, dispatch into the reorder buffer (and the
+    load/store queue for a lw/sw), issue once its sources are ready and
+    in-order commit, against what the instructions before it left behind:
+        rob[i % rob_size]  the cycle instruction i commits, freeing its entry
+        lsq[k % lsq_size]  the same for the k-th lw/sw
+        iq                 a min-heap of the issue cycles still in the issue queue
+        slots[c % OOO_ISSUE_SLOTS]  what issued in cycle c, for the issue width
+    ready[r] is the cycle register r's value can first be used. A branch is
+    only resolved against the predictor once the instruction after it shows
+    where it went. Every unit is pipelined. */
+typedef struct ooo_slot {
+    uint64_t cycle;
+    uint8_t issued;
+    uint8_t mem;
+    uint8_t branch;
+} ooo_slot_t;
+
+typedef struct ooo_core {
+    int rob_size;
+    int iq_size;
+    int lsq_size;
+    int latency[FU_COUNT];
+    uint64_t* rob;
+    uint64_t* lsq;
+    uint64_t* iq;
+    int iq_count;
+    ooo_slot_t* slots;
+    uint64_t ready[32];
+
+    uint64_t fetch_cycle;    // the cycle the next instruction can be fetched in
+    int fetched;             // ... and how many already were in it
+    uint64_t dispatch_cycle;
+    int dispatched;
+    uint64_t commit_cycle;
+    int committed;
+    unsigned int last_address;
+    int branch_pending;      // the last instruction was a branch, still to be resolved
+    unsigned int branch_address;
+    uint64_t branch_complete;
+
+    long instructions;
+    long mem_ops;
+    long rob_stalls;         // dispatch cycles lost to a full reorder buffer
+    long iq_stalls;          // ... to a full issue queue
+    long lsq_stalls;         // ... to a full load/store queue
+    long load_misses;
+    long miss_latency;       // cycles data misses of lw took beyond a hit
+    long exposed_latency;    // ... that still held commit up
+} ooo_t;
+
+/*  What the simulator can trace as it runs, each one a bit of
+    sim_config_t.events. The default set is what the simulator has always
+    printed: every fetch and data access and, interactively, the pipeline. */
+enum event_type {EVENT_FETCH_HIT, EVENT_FETCH_MISS, EVENT_DATA_HIT, EVENT_DATA_MISS, EVENT_PIPELINE,
+                 EVENT_RETIRE, EVENT_STALL, EVENT_MISPREDICT, EVENT_TYPES};
+#define EVENTS_DEFAULT (EVENT_BIT(EVENT_FETCH_HIT) | EVENT_BIT(EVENT_FETCH_MISS) | \
+                        EVENT_BIT(EVENT_DATA_HIT) | EVENT_BIT(EVENT_DATA_MISS) | EVENT_BIT(EVENT_PIPELINE))
+
+// text formats the events like the reports, binary writes the event_t records as they are
+enum event_sink {EVENT_SINK_TEXT, EVENT_SINK_BINARY, EVENT_SINK_NONE, EVENT_SINK_COUNT};
+
+/*  One traced event, also the record of the binary event file. itype is
+    the instruction's enum instruction_type and arg depends on the type:
+    the stage of EVENT_PIPELINE and the cycles lost for misses and stalls. */
+typedef struct event {
+    uint32_t cycle;
+    uint32_t address;
+    uint16_t type;
+    uint16_t itype;
+    int32_t arg;
+} event_t;
+
+/*  Single producer, single consumer ring between the simulator and the
+    thread writing its sink. The simulator only moves head and the writer
+    only moves tail, so neither side ever takes a lock. They sit on their
+    own cache lines so the two threads don't fight over one line. */
+typedef struct event_ring {
+    _Alignas(64) _Atomic uint32_t head; // next slot the simulator fills
+    _Alignas(64) _Atomic uint32_t tail; // next slot the writer drains
+    _Alignas(64) uint32_t free_tail;    // the simulator's last look at tail
+    atomic_int stop;
+    event_t* events;
+    FILE* file;     // where the sink writes
+    int owns_file;  // file was opened for -eventfile
+    pthread_t writer;
+} event_ring_t;
+
+/*  -interval snapshots: what happened in each interval of instructions, as
+    counts[] indexed by enum interval_count. The binary interval file is
+    these records as they are, in host byte order. */
+typedef struct interval {
+    uint64_t index;                   // intervals before this one
+    uint64_t end;                     // instructions retired by the end of it
+    uint64_t counts[INTERVAL_COUNTS];
+} interval_t;
+
+/*  Ring between the simulator and the thread writing the interval file,
+    the same single producer, single consumer scheme as event_ring_t. */
+typedef struct interval_ring {
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    atomic_int stop;
+    interval_t intervals[INTERVAL_RING_SIZE];
+    FILE* file;
+    int format;
+    pthread_t writer;
+} interval_ring_t;
+
+/*  Everything one simulation owns. Nothing in the simulator touches global
+    state, so any number of these can be alive in a process at once. */
+typedef struct sim {
+    sim_config_t config;
+
+    // Cache Variables
+    cache_t cache;  // the instruction cache, also holds data with DCACHE_UNIFIED
+    cache_t dcache; // the data cache with DCACHE_SPLIT
+    cache_t level[CACHE_MAX_LEVELS - 1]; // the levels below L1, level[0] is L2
+    predictor_t predictor;
+    ooo_t* ooo; // the out-of-order core, NULL when the pipeline times instructions
+
+    /*  Register scoreboard: ready[r] is the first hazard_clock tick an
+        instruction can be in ALU with register r, pending the registers
+        that may still be waited on. hazard_clock counts pushes, a data
+        miss stalls every stage alike so it doesn't count. */
+    uint32_t ready[32];
+    uint32_t pending;
+    uint32_t pending_loads; // the pending registers a lw writes
+    uint32_t hazard_clock;
+    int held;             // the stage the last push held everything in front of, 0 if none
+    long hazard_stalls;   // cycles the scoreboard held the pipeline
+    long load_use_stalls; // ... of them waiting on a lw
+    int memory_latency;
+    int miss_cycles;    // how long the last L1 miss took to service
+    long memory_cycles; // cycles spent servicing every L1 miss so far
+    long fetch_memory_cycles; // ... of them fetch misses
+
+    // Cache Statistics, instruction fetches in cache_* and lw/sw in data_*
+    long cache_miss;
+    long cache_access;
+    long cache_hit;
+    long data_miss;
+    long data_access;
+    long data_hit;
+
+    /*  The pipeline is a ring of slots, stage s lives in slot
+        (pipeline_head + s) % pipeline_depth, so a push just moves the head.
+        Each slot is a bundle of up to width instructions, filled from lane
+        0 in program order; an empty lane is a bubble. */
+    pipeline_t pipeline[MAX_STAGES][MAX_WIDTH];
+    int pipeline_head;
+    int pipeline_depth;
+    int width;
+    int mem_ports;
+    int branch_units;
+    int branch_stage;
+    int mem_stage;
 
+    unsigned int instruction_address;
+    unsigned int pipeline_cycles;   // how many cycles did you pipeline consume
+    unsigned int instruction_count; // home many real instructions ran thru the pipeline
+    unsigned int branch_predict_taken;
+    unsigned int branch_count;
+    unsigned int correct_branch_predictions;
+
+    inst_stats_t inst_stats;
+
+    unsigned int dump_pipeline;
+    FILE* out; // where the simulator writes its reports
+
+    /*  Sampled simulation: each sample_period records end in sample_warmup
+        timed records and a window of sample_window measured ones, the rest
+        only warm the caches and the predictor, see iplc_sim_sample(). */
+    long sample_period;         // 0 when every record is timed
+    long sample_window;
+    long sample_warmup;
+    long sample_records;        // records seen so far
+    long sample_start;          // the record the open window started at, -1 if none is open
+    unsigned int sample_cycles; // pipeline_cycles as it started
+    unsigned int warm_branch;   // a warmed branch still to learn where it went, 0 if none
+    int warming;                // the last record was only warmed
+    long warmed;
+    long samples;
+    double sample_cpi;          // the sum of the windows' CPI
+    double sample_cpi_squares;  // ... and of its squares
+
+    unsigned int events;  // EVENT_BIT mask of what is traced, 0 once the sink is closed
+    event_ring_t* ring;   // NULL when nothing is traced
+
+    pc_table_t pc_stats;  // misses by instruction for -hotspots
+
+    interval_ring_t* interval_ring;          // NULL without -interval
+    uint64_t interval_last[INTERVAL_COUNTS]; // the totals of the last snapshot
+    uint64_t interval_next;                  // instructions retired at the next one
+    uint64_t intervals;                      // snapshots taken
+
+    // Mnemonic table used by iplc_sim_parse_instruction()
+    trace_mnemonics_t parse_mnemonics;
+} sim_t;
+
+// The bundle holding a pipeline stage, see sim_t; index it for the other lanes
+static inline pipeline_t* iplc_sim_stage(sim_t *sim, int stage) {
+    int slot = sim->pipeline_head + stage;
+
+    return sim->pipeline[slot >= sim->pipeline_depth ? slot - sim->pipeline_depth : slot];
+}
 
+void iplc_sim_event_push(sim_t *sim, int type, unsigned int address, int itype, int arg);
 
-//*****Cache Function Implementations*****//
-// Correctly configure the cache
-void iplc_sim_init(int index, int blocksize, int assoc) {
-    int i;
-    unsigned long cache_size = 0;
-    cache_index = index;
-    cache_blocksize = blocksize;
-    cache_assoc = assoc;
-    
-    cache_blockoffsetbits = (int) ceil((blocksize * 4) / 2);
-    /* Note: rint function rounds the result up prior to casting */
-    
-    cache_size = assoc * (1 << index) * ((32 * blocksize) + 33 - index - cache_blockoffsetbits);
-    
-    printf("Cache Configuration \n");
-    printf("   Index: %d bits or %d lines \n", cache_index, (1 << cache_index));
-    printf("   BlockSize: %d \n", cache_blocksize);
-    printf("   Associativity: %d \n", cache_assoc);
-    printf("   BlockOffSetBits: %d \n", cache_blockoffsetbits);
-    printf("   CacheSize: %lu \n", cache_size);
-    
-    if (cache_size > MAX_CACHE_SIZE) {
-        printf("Cache too big. Great than MAX SIZE of %d .... \n", MAX_CACHE_SIZE);
-        exit(-1);
-    }
-    
-    cache = (cache_line_t*) malloc((sizeof(cache_line_t) * 1 << index));
-    
-    // Dynamically create our cache based on the information the user entered
-    for (i = 0; i < (1 << index); i++) {
-        // Dynamically allocate the members of each cache set
-        cache[i].valid_bit = (char*) calloc(assoc, sizeof(char)); // We use calloc to initialize the valid bits to zero
-        cache[i].tag = (int*) malloc(sizeof(int) * assoc);
-        cache[i].age = (int*) calloc(assoc, sizeof(int));
+/*  Trace an event if its type was asked for. Costs one test of a mask
+    otherwise, and nothing at all when built with IPLC_SIM_NO_EVENTS. */
+static inline void iplc_sim_event(sim_t *sim, int type, unsigned int address, int itype, int arg) {
+#ifndef IPLC_SIM_NO_EVENTS
+    if (sim->events & EVENT_BIT(type))
+        iplc_sim_event_push(sim, type, address, itype, arg);
+#endif
+}
+
+/*  -profile splits the run's time, and where the CPU lets us read them
+    cheaply its hardware counters, between the phases of the simulator. A
+    phase is charged for the time spent in it but not in the phases it
+    calls, so a data lookup made from the pipeline counts as lookup. A
+    profile belongs to the simulator and trace reader it is handed to, see
+    sim_config_t, and counts the thread that started it, so simulators run
+    on other threads need profiles of their own. */
+enum profile_phase {PROFILE_OTHER, PROFILE_PARSE, PROFILE_LOOKUP, PROFILE_REPLACEMENT, PROFILE_PIPELINE,
+                    PROFILE_PHASES};
+enum profile_counter {COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_LLC_MISSES, COUNTER_BRANCH_MISSES,
+                      PROFILE_COUNTERS};
+
+struct perf_event_mmap_page;
+
+typedef struct profile {
+    int depth;
+    int stack[PROFILE_DEPTH];            // the phases entered, the innermost is running
+    uint64_t last;                       // timestamp of the last change of phase
+    uint64_t last_count[PROFILE_COUNTERS];
+    uint64_t ticks[PROFILE_PHASES];
+    uint64_t calls[PROFILE_PHASES];
+    uint64_t counts[PROFILE_PHASES][PROFILE_COUNTERS];
+    int per_phase;                       // every counter can be read with rdpmc at each change of phase
+    int fd[PROFILE_COUNTERS];            // -1 where perf_event_open failed
+    struct perf_event_mmap_page* page[PROFILE_COUNTERS];
+    uint64_t start_count[PROFILE_COUNTERS];
+    uint64_t start_ticks;
+    struct timespec start;
+    int error;                           // errno of the first perf_event_open that failed
+} profile_t;
+
+void iplc_sim_profile_charge(profile_t *profile);
+
+// Start charging time to phase, until the matching iplc_sim_profile_leave(); profile may be NULL
+static inline void iplc_sim_profile_enter(profile_t *profile, int phase) {
+#ifndef IPLC_SIM_NO_PROFILE
+    if (profile != NULL) {
+        iplc_sim_profile_charge(profile);
+        profile->stack[++profile->depth] = phase;
+        profile->calls[phase]++;
     }
-    
-    // Init the pipeline -- set all data to zero and instructions to NOP
-    for (i = 0; i < MAX_STAGES; i++) {
-        // itype is set to O which is NOP type instruction
-        bzero(&(pipeline[i]), sizeof(pipeline_t));
+#endif
+}
+
+// Go back to charging the phase that was running before the last iplc_sim_profile_enter()
+static inline void iplc_sim_profile_leave(profile_t *profile) {
+#ifndef IPLC_SIM_NO_PROFILE
+    if (profile != NULL) {
+        iplc_sim_profile_charge(profile);
+        profile->depth--;
     }
+#endif
 }
-/*
-void iplc_sim_close() {
-	int i;
-	// Dealocate all sets in the cache
-	for (i = 0; i < cache_assoc; i++) {
-		free(cache[i]);
-	}
-	// Dealocate the cache array
-	free(cache);
+
+
+
+//*****Cache Address Mapping*****//
+/*  The address mapping shared by the cache and the stack distance analysis,
+    so both always agree on which addresses are the same line. */
+static inline int iplc_sim_cache_blockoffsetbits(int blocksize) {
+    return (int) ceil((blocksize * 4) / 2);
+    /* Note: rint function rounds the result up prior to casting */
 }
-*/
 
-/*  iplc_sim_trap_address() determined this is not in our cache. Put it there
-    and make sure that is now our Most Recently Used (MRU) entry. */
-void iplc_sim_LRU_replace_on_miss(int index, int tag) {
-    int i;
-    int oldest_age = 0;
-    int target_line = 0;
-    
-    // Find the target block to insert our new block
-    for (i = 0; i < cache_assoc; i++) {
-        // If there is an empty space, just insert it
-        if (cache[index].valid_bit[i] == 0) {
-            target_line = i;
-            break;
-        }
-        
-        // Find the oldest block and mark it for replacement
-        if (cache[index].age[i] > oldest_age) {
-            oldest_age = cache[index].age[i];
-            target_line = i;
-        }
+static inline int iplc_sim_cache_set(int index_bits, int blockoffsetbits, unsigned int address) {
+    return ((1 << index_bits) - 1) & (address >> blockoffsetbits); // Isolates the index
+}
+
+static inline int iplc_sim_cache_tag(int index_bits, int blockoffsetbits, unsigned int address) {
+    return address >> (index_bits + blockoffsetbits); // Isolates the tag
+}
+
+
+
+//*****Replacement Policies*****//
+/*  A replacement policy keeps state_bytes(assoc) bytes of its own in every
+    set, starting at a multiple of state_align within the set. The cache
+    fills invalid ways first (lowest way number), so victim() is only asked
+    to choose once every way of the set is valid. touch() is called on a
+    hit, fill() after a new line was put in a way and evict() just before a
+    valid way is invalidated; valid is the set's valid mask before the
+    access. */
+typedef struct replacement_ops {
+    const char* name;
+    int (*state_bytes)(int assoc);
+    int state_align;
+    int (*victim)(cache_t *cache, uint8_t *state);
+    void (*touch)(cache_t *cache, uint8_t *state, int way, uint64_t valid);
+    void (*fill)(cache_t *cache, uint8_t *state, int way, uint64_t valid);
+    void (*evict)(cache_t *cache, uint8_t *state, int way, uint64_t valid);
+} replacement_ops_t;
+
+#define RRIP_MAX 3        // 2-bit re-reference prediction values
+#define BRRIP_LONG_ODDS 32 // BRRIP inserts at RRIP_MAX - 1 once every this many fills
+
+// xorshift64*, one stream per cache so runs are repeatable
+static inline uint64_t iplc_sim_random(cache_t *cache) {
+    cache->rng ^= cache->rng >> 12;
+    cache->rng ^= cache->rng << 25;
+    cache->rng ^= cache->rng >> 27;
+    return cache->rng * 0x2545F4914F6CDD1Dull;
+}
+
+// Mask with one bit for each of the assoc ways
+static inline uint64_t iplc_sim_all_ways(int assoc) {
+    return (assoc == 64) ? ~0ull : (1ull << assoc) - 1;
+}
+
+static int repl_bytes_per_way(int assoc) { return assoc; }
+static int repl_bytes_mask(int assoc) { return sizeof(uint64_t); }
+static int repl_bytes_one(int assoc) { return 1; }
+static int repl_bytes_none(int assoc) { return 0; }
+
+// For the policies with nothing to do on one of the events
+static void repl_ignore(cache_t *cache, uint8_t *state, int way, uint64_t valid) {
+}
+
+/*  True LRU as a recency stack of way numbers, most recent first. Only the
+    first popcount(valid) entries are meaningful. */
+static int lru_victim(cache_t *cache, uint8_t *stack) {
+    return stack[cache->assoc - 1];
+}
+
+static void lru_touch(cache_t *cache, uint8_t *stack, int way, uint64_t valid) {
+    int depth = __builtin_popcountll(valid);
+    uint8_t *pos = (uint8_t*) memchr(stack, way, depth);
+    int n = pos ? (int) (pos - stack) : depth;
+
+    memmove(stack + 1, stack, n);
+    stack[0] = (uint8_t) way;
+}
+
+// Drop the way to the bottom of the valid part of the stack, it is about to leave it
+static void lru_evict(cache_t *cache, uint8_t *stack, int way, uint64_t valid) {
+    int depth = __builtin_popcountll(valid);
+    int n = (int) ((uint8_t*) memchr(stack, way, depth) - stack);
+
+    memmove(stack + n, stack + n + 1, depth - 1 - n);
+    stack[depth - 1] = (uint8_t) way;
+}
+
+/*  Tree PLRU: assoc - 1 node bits in heap order (node 1 is the root), each
+    pointing at the half of its subtree to evict from next. */
+static int tree_plru_victim(cache_t *cache, uint8_t *state) {
+    uint64_t bits = *(uint64_t*) state;
+    int node = 1;
+
+    while (node < cache->assoc)
+        node = 2 * node + (int) ((bits >> node) & 1);
+    return node - cache->assoc;
+}
+
+static void tree_plru_touch(cache_t *cache, uint8_t *state, int way, uint64_t valid) {
+    uint64_t *bits = (uint64_t*) state;
+    int node = way + cache->assoc;
+
+    // Walk up from the leaf, pointing every node away from this way
+    while (node > 1) {
+        int right = node & 1;
+        node >>= 1;
+        if (right)
+            *bits &= ~(1ull << node);
+        else
+            *bits |= 1ull << node;
     }
-    
-    // Replace the tage of the target block and change the valid bit
-    cache[index].tag[target_line] = tag;
-    cache[index].valid_bit[target_line] = 1;
-    
-    // We now update the data for all valid blocks
-    iplc_sim_LRU_update_on_hit(index, target_line);
 }
 
-/*  iplc_sim_trap_address() determined the entry is in our cache. Update its
-    information in the cache. */
-void iplc_sim_LRU_update_on_hit(int index, int assoc_entry) {
+/*  Bit PLRU: one MRU bit per way, evict the first way without it. When the
+    last bit would be set they are all cleared except the one just used. */
+static int bit_plru_victim(cache_t *cache, uint8_t *state) {
+    uint64_t candidates = ~*(uint64_t*) state & iplc_sim_all_ways(cache->assoc);
+
+    // A direct mapped set never has a way without its MRU bit
+    return candidates ? __builtin_ctzll(candidates) : 0;
+}
+
+static void bit_plru_touch(cache_t *cache, uint8_t *state, int way, uint64_t valid) {
+    uint64_t *mru = (uint64_t*) state;
+
+    *mru |= 1ull << way;
+    if (*mru == iplc_sim_all_ways(cache->assoc))
+        *mru = 1ull << way;
+}
+
+static void bit_plru_evict(cache_t *cache, uint8_t *state, int way, uint64_t valid) {
+    *(uint64_t*) state &= ~(1ull << way);
+}
+
+// FIFO: a pointer to the oldest way, which moves on when that way is refilled
+static int fifo_victim(cache_t *cache, uint8_t *next) {
+    return *next;
+}
+
+static void fifo_fill(cache_t *cache, uint8_t *next, int way, uint64_t valid) {
+    if (way == *next)
+        *next = (uint8_t) ((way + 1) % cache->assoc);
+}
+
+static int random_victim(cache_t *cache, uint8_t *state) {
+    return (int) (iplc_sim_random(cache) % cache->assoc);
+}
+
+/*  SRRIP (Jaleel et al., ISCA 2010): a 2-bit re-reference prediction value
+    per way. Hits predict near re-reference, new lines a long one, and the
+    victim is the first way predicted distant, ageing the set until one is. */
+static int rrip_victim(cache_t *cache, uint8_t *rrpv) {
     int i;
-   
-    // Update all age counters for each valid line
-    cache[index].age[assoc_entry] = 0;
-    for (i = 0; i < cache_assoc; i++) {
-        if (cache[index].valid_bit[i] == 1) {
-            cache[index].age[i] += 1;
+
+    while (1) {
+        for (i = 0; i < cache->assoc; i++) {
+            if (rrpv[i] == RRIP_MAX)
+                return i;
         }
+        for (i = 0; i < cache->assoc; i++)
+            rrpv[i]++;
     }
 }
 
-/*  Check if the address is in our cache. Update our counter statistics 
-    for cache_access, cache_hit, etc. If our configuration supports
-    associativity we may need to check through multiple entries for our
-    desired index.  In that case we will also need to call the LRU functions. */
-int iplc_sim_trap_address(unsigned int address) {
+static void rrip_touch(cache_t *cache, uint8_t *rrpv, int way, uint64_t valid) {
+    rrpv[way] = 0;
+}
 
-    int i, hit = 0, set_element = 0;
-    int index = (1 << cache_index - 1)  & (address >> cache_blockoffsetbits); // Isolates the index
+static void srrip_fill(cache_t *cache, uint8_t *rrpv, int way, uint64_t valid) {
+    rrpv[way] = RRIP_MAX - 1;
+}
 
-    int tag = address >> (cache_index + cache_blockoffsetbits); // Isolates the tag
-    
-    // Search for the appropriate tag in the appropriate set
-    for (i = 0; i < cache_assoc; i++) {
-        // Handle the case of a cahe hit
-        if (cache[index].valid_bit[i] == 1 && cache[index].tag[i] == tag) {
-            hit = 1;
-            cache_hit += 1;
-            iplc_sim_LRU_update_on_hit(index, i);
-            break;
-        }
-    }
-    
-    // Handle the case of a cache miss
-    if (!hit) {
-        cache_miss += 1;
-        iplc_sim_LRU_replace_on_miss(index, tag);
-    }
-    
-    // Increment access counter
-    cache_access += 1;
-    
-    // Expects you to return 1 for hit, 0 for miss
-    return hit;
+// BRRIP: like SRRIP but new lines are mostly predicted distant, which resists thrashing
+static void brrip_fill(cache_t *cache, uint8_t *rrpv, int way, uint64_t valid) {
+    rrpv[way] = (iplc_sim_random(cache) % BRRIP_LONG_ODDS == 0) ? RRIP_MAX - 1 : RRIP_MAX;
 }
 
-// Just output our summary statistics.
-void iplc_sim_finalize() {
-    // Finish processing all instructions in the Pipeline
-    while (pipeline[FETCH].itype != NOP || pipeline[DECODE].itype != NOP || pipeline[ALU].itype != NOP ||
-           pipeline[MEM].itype != NOP   || pipeline[WRITEBACK].itype != NOP) {
-        iplc_sim_push_pipeline_stage();
+const replacement_ops_t replacement_ops[REPL_COUNT] = {
+    [REPL_LRU]       = {"lru",       repl_bytes_per_way, 1,                  lru_victim,       lru_touch,       lru_touch,       lru_evict},
+    [REPL_TREE_PLRU] = {"tree-plru", repl_bytes_mask,    _Alignof(uint64_t), tree_plru_victim, tree_plru_touch, tree_plru_touch, repl_ignore},
+    [REPL_BIT_PLRU]  = {"bit-plru",  repl_bytes_mask,    _Alignof(uint64_t), bit_plru_victim,  bit_plru_touch,  bit_plru_touch,  bit_plru_evict},
+    [REPL_FIFO]      = {"fifo",      repl_bytes_one,     1,                  fifo_victim,      repl_ignore,     fifo_fill,       repl_ignore},
+    [REPL_RANDOM]    = {"random",    repl_bytes_none,    1,                  random_victim,    repl_ignore,     repl_ignore,     repl_ignore},
+    [REPL_SRRIP]     = {"srrip",     repl_bytes_per_way, 1,                  rrip_victim,      rrip_touch,      srrip_fill,      repl_ignore},
+    [REPL_BRRIP]     = {"brrip",     repl_bytes_per_way, 1,                  rrip_victim,      rrip_touch,      brrip_fill,      repl_ignore},
+};
+
+const char* data_cache_modes[DCACHE_COUNT] = {"none", "split", "unified"};
+const char* inclusion_policies[INCLUSION_COUNT] = {"nine", "inclusive", "exclusive"};
+const char* forwarding_modes[FWD_COUNT] = {"legacy", "full", "mem", "none"};
+const char* core_models[CORE_COUNT] = {"inorder", "ooo"};
+const char* fu_names[FU_COUNT] = {"alu", "mul", "div", "agu", "branch"};
+const int fu_default_latency[FU_COUNT] = {1, 3, 12, 1, 1};
+const char* trace_patterns[PATTERN_COUNT] = {"stream", "stride", "random", "loop", "chase"};
+
+// Look a forwarding mode up by name, -1 if there is no such mode
+int iplc_sim_forwarding_mode(const char *name) {
+    int i;
+
+    for (i = 0; i < FWD_COUNT; i++) {
+        if (strcmp(forwarding_modes[i], name) == 0)
+            return i;
     }
-    
-    printf(" Cache Performance \n");
-    printf("\t Number of Cache Accesses is %ld \n", cache_access);
-    printf("\t Number of Cache Misses is %ld \n", cache_miss);
-    printf("\t Number of Cache Hits is %ld \n", cache_hit);
-    printf("\t Cache Miss Rate is %f \n\n", (double)cache_miss / (double) cache_access);
-    printf("Pipeline Performance \n");
-    printf("\t Total Cycles is %u \n", pipeline_cycles);
-    printf("\t Total Instructions is %u \n", instruction_count);
-    printf("\t Total Branch Instructions is %u \n", branch_count);
-    printf("\t Total Correct Branch Predictions is %u \n", correct_branch_predictions);
-    printf("\t CPI is %f \n\n", (double)pipeline_cycles / (double) instruction_count);
+    return -1;
 }
 
+// Look a synthetic trace pattern up by name, -1 if there is no such pattern
+int iplc_sim_trace_pattern(const char *name) {
+    int i;
 
+    for (i = 0; i < PATTERN_COUNT; i++) {
+        if (strcmp(trace_patterns[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
 
-//*****Pipeline Functions*****//
-// Dump the current contents of our pipeline
-void iplc_sim_dump_pipeline() {
+// Look a core model up by name, -1 if there is no such model
+int iplc_sim_core_model(const char *name) {
     int i;
-    
-    for (i = 0; i < MAX_STAGES; i++) {
-        switch(i) {
-            case FETCH:
-                printf("(cyc: %u) FETCH:\t %d: 0x%x \t", pipeline_cycles, pipeline[i].itype,
-                       pipeline[i].instruction_address);
-                break;
-            case DECODE:
-                printf("DECODE:\t %d: 0x%x \t", pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            case ALU:
-                printf("ALU:\t %d: 0x%x \t", pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            case MEM:
-                printf("MEM:\t %d: 0x%x \t", pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            case WRITEBACK:
-                printf("WB:\t %d: 0x%x \n", pipeline[i].itype, pipeline[i].instruction_address);
-                break;
-            default:
-                printf("DUMP: Bad stage!\n" );
-                exit(-1);
+
+    for (i = 0; i < CORE_COUNT; i++) {
+        if (strcmp(core_models[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char* event_names[EVENT_TYPES] = {"fetch-hit", "fetch-miss", "data-hit", "data-miss", "pipeline",
+                                        "retire", "stall", "mispredict"};
+const char* event_sinks[EVENT_SINK_COUNT] = {"text", "binary", "none"};
+const char* interval_formats[INTERVAL_FORMAT_COUNT] = {"csv", "binary"};
+const char* result_formats[RESULT_FORMAT_COUNT] = {"json", "csv"};
+const char* objectives[OBJECTIVE_COUNT] = {"cpi+cmr", "cpi", "cmr", "dmr", "mpki", "cycles", "mispredict"};
+const char* interval_columns[INTERVAL_COUNTS] = {"instructions", "cycles", "fetches", "fetch_misses",
+                                                 "data_accesses", "data_misses", "branches", "mispredictions",
+                                                 "fetch_stalls", "data_stalls", "branch_stalls", "hazard_stalls",
+                                                 "structural_stalls"};
+
+/*  Parse a comma separated list of event names into an EVENT_BIT mask.
+    fetch and data stand for both their hits and misses, all for everything.
+    Returns 0 if a name isn't known. */
+unsigned int iplc_sim_event_mask(const char *list) {
+    unsigned int mask = 0;
+    char name[32];
+    int i, n;
+
+    while (*list) {
+        n = strcspn(list, ",");
+        if (n == 0 || n >= (int) sizeof(name))
+            return 0;
+        memcpy(name, list, n);
+        name[n] = '\0';
+        list += list[n] ? n + 1 : n;
+
+        if (strcmp(name, "all") == 0) {
+            mask |= EVENT_BIT(EVENT_TYPES) - 1;
+        } else if (strcmp(name, "fetch") == 0) {
+            mask |= EVENT_BIT(EVENT_FETCH_HIT) | EVENT_BIT(EVENT_FETCH_MISS);
+        } else if (strcmp(name, "data") == 0) {
+            mask |= EVENT_BIT(EVENT_DATA_HIT) | EVENT_BIT(EVENT_DATA_MISS);
+        } else {
+            for (i = 0; i < EVENT_TYPES && strcmp(event_names[i], name) != 0; i++)
+                ;
+            if (i == EVENT_TYPES)
+                return 0;
+            mask |= EVENT_BIT(i);
         }
     }
+    return mask;
 }
 
-/*  Check if various stages of our pipeline require stalls, forwarding, etc.
-    Then push the contents of our various pipeline stages through the pipeline */
-void iplc_sim_push_pipeline_stage()
-{
+// Look an event sink up by name, -1 if there is no such sink
+int iplc_sim_event_sink(const char *name) {
     int i;
-    int data_hit=1;
 
-    int stall = 0;
-    
-    /* 1. Count WRITEBACK stage is "retired" -- This I'm giving you */
-    if (pipeline[WRITEBACK].instruction_address) {
-        instruction_count++;
-        if (debug)
-            printf("DEBUG: Retired Instruction at 0x%x, Type %d, at Time %u \n",
-                   pipeline[WRITEBACK].instruction_address, pipeline[WRITEBACK].itype, pipeline_cycles);
+    for (i = 0; i < EVENT_SINK_COUNT; i++) {
+        if (strcmp(event_sinks[i], name) == 0)
+            return i;
     }
-    
-    /* 2. Check for BRANCH and correct/incorrect Branch Prediction */
-    if (pipeline[DECODE].itype == BRANCH) {
-        int branch_taken = 0;
-        branch_count++;
-        if(pipeline[FETCH].instruction_address != (pipeline[DECODE].instruction_address + 4) ){
-            branch_taken++;
-        }
-        if(branch_predict_taken){ // if choose predict take branches and next instruction is not at address+4,
-                          // prediction correct.  Else add nop for stall
-            if(branch_taken){
-                correct_branch_predictions++;
-            }
-            else{
-                //memcpy(&pipeline[WRITEBACK], &pipeline[MEM], sizeof(pipeline_t));
-                //memcpy(&pipeline[MEM], &pipeline[ALU], sizeof(pipeline_t));
-                //memcpy(&pipeline[ALU], &pipeline[DECODE], sizeof(pipeline_t));
-                //memcpy(&pipeline[DECODE], &pipeline[FETCH], sizeof(pipeline_t));
-                //bzero(&(pipeline[FETCH]), sizeof(pipeline_t));
-                stall = 1; // if incorrect remove this variable and just increment cycles
-            }
-        }
-        else{
-            if(!branch_taken){
-                correct_branch_predictions++;
-            }
-            else{
-                //memcpy(&pipeline[WRITEBACK], &pipeline[MEM], sizeof(pipeline_t));
-                //memcpy(&pipeline[MEM], &pipeline[ALU], sizeof(pipeline_t));
-                //memcpy(&pipeline[ALU], &pipeline[DECODE], sizeof(pipeline_t));
-                //memcpy(&pipeline[DECODE], &pipeline[FETCH], sizeof(pipeline_t));
-                //bzero(&(pipeline[FETCH]), sizeof(pipeline_t));
-                stall = 1;
-            }
-        }
+    return -1;
+}
+
+// Look an interval file format up by name, -1 if there is no such format
+int iplc_sim_interval_format(const char *name) {
+    int i;
+
+    for (i = 0; i < INTERVAL_FORMAT_COUNT; i++) {
+        if (strcmp(interval_formats[i], name) == 0)
+            return i;
     }
-    
-    /* 3. Check for LW delays due to use in ALU stage and if data hit/miss
-     *    add delay cycles if needed.
-     */
-    if (pipeline[MEM].itype == LW) {
-        int inserted_nop = 0;
-        if(pipeline[ALU].itype == RTYPE){
-            if(pipeline[ALU].stage.rtype.reg1 == pipeline[MEM].stage.lw.dest_reg
-                || pipeline[ALU].stage.rtype.reg2_or_constant == pipeline[MEM].stage.lw.dest_reg){
-                stall++;
-            }
-        }
+    return -1;
+}
+
+// Look a -results format up by name, -1 if there is no such format
+int iplc_sim_result_format(const char *name) {
+    int i;
+
+    for (i = 0; i < RESULT_FORMAT_COUNT; i++) {
+        if (strcmp(result_formats[i], name) == 0)
+            return i;
     }
-    
-    /* 4. Check for SW mem acess and data miss .. add delay cycles if needed */
-    if (pipeline[MEM].itype == SW) {
-        if(pipeline[ALU].itype == RTYPE){
-            if(pipeline[ALU].stage.rtype.dest_reg == pipeline[MEM].stage.sw.base_reg){
-                stall++;
-            }
-        }
+    return -1;
+}
+
+// Look an objective up by name, -1 if there is no such objective
+int iplc_sim_objective(const char *name) {
+    int i;
+
+    for (i = 0; i < OBJECTIVE_COUNT; i++) {
+        if (strcmp(objectives[i], name) == 0)
+            return i;
     }
-    
-    /* 5. Increment pipe_cycles 1 cycle for normal processing */
-    pipeline_cycles++;
-    /* 6. push stages thru MEM->WB, ALU->MEM, DECODE->ALU, FETCH->ALU */ // FETCH->DECODE
-    memcpy(&pipeline[WRITEBACK], &pipeline[MEM], sizeof(pipeline_t));
-    memcpy(&pipeline[MEM], &pipeline[ALU], sizeof(pipeline_t));
-    memcpy(&pipeline[ALU], &pipeline[DECODE], sizeof(pipeline_t));
-    memcpy(&pipeline[DECODE], &pipeline[FETCH], sizeof(pipeline_t));
+    return -1;
+}
+
+// Look an inclusion policy up by name, -1 if there is no such policy
+int iplc_sim_inclusion_policy(const char *name) {
+    int i;
 
+    for (i = 0; i < INCLUSION_COUNT; i++) {
+        if (strcmp(inclusion_policies[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
 
-    
-    // 7. This is a give'me -- Reset the FETCH stage to NOP via bezero */
-    bzero(&(pipeline[FETCH]), sizeof(pipeline_t));
+// Look a data cache mode up by name, -1 if there is no such mode
+int iplc_sim_data_cache_mode(const char *name) {
+    int i;
 
-    if(stall){
-        iplc_sim_push_pipeline_stage();
+    for (i = 0; i < DCACHE_COUNT; i++) {
+        if (strcmp(data_cache_modes[i], name) == 0)
+            return i;
     }
+    return -1;
 }
 
-/*
- * This function is fully implemented.  You should use this as a reference
- * for implementing the remaining instruction types.
- */
-void iplc_sim_process_pipeline_rtype(char *instruction, int dest_reg, int reg1, int reg2_or_constant)
-{
-    /* This is an example of what you need to do for the rest */
-    iplc_sim_push_pipeline_stage();
-    
-    pipeline[FETCH].itype = RTYPE;
-    pipeline[FETCH].instruction_address = instruction_address;
-    
-    strcpy(pipeline[FETCH].stage.rtype.instruction, instruction);
-    pipeline[FETCH].stage.rtype.reg1 = reg1;
-    pipeline[FETCH].stage.rtype.reg2_or_constant = reg2_or_constant;
-    pipeline[FETCH].stage.rtype.dest_reg = dest_reg;
+// Look a policy up by name, -1 if there is no such policy
+int iplc_sim_replacement_policy(const char *name) {
+    int i;
 
-    inst_stats.rtype++;
+    for (i = 0; i < REPL_COUNT; i++) {
+        if (strcmp(replacement_ops[i].name, name) == 0)
+            return i;
+    }
+    return -1;
 }
 
-void iplc_sim_process_pipeline_lw(int dest_reg, int base_reg, unsigned int data_address)
-{
-    /* You must implement this function */
-    iplc_sim_push_pipeline_stage();
 
-    pipeline[FETCH].itype = LW;
-    pipeline[FETCH].instruction_address = instruction_address;
 
-    pipeline[FETCH].stage.lw.data_address = data_address;
-    pipeline[FETCH].stage.lw.dest_reg = dest_reg;
-    pipeline[FETCH].stage.lw.base_reg = base_reg;
+//*****Branch Predictors*****//
+/*  predict() looks at the tables as they are when the branch is fetched and
+    update() trains them once it resolved. Both see the global history
+    before this branch is shifted into it. */
+typedef struct predictor_ops {
+    const char* name;
+    int (*predict)(predictor_t *pred, unsigned int address);
+    void (*update)(predictor_t *pred, unsigned int address, int taken);
+} predictor_ops_t;
 
-    inst_stats.lw++;
+static inline uint32_t predictor_index(unsigned int address, int bits) {
+    return (address >> 2) & ((1u << bits) - 1); // instructions are word aligned
 }
 
-void iplc_sim_process_pipeline_sw(int src_reg, int base_reg, unsigned int data_address)
-{
-    /* You must implement this function */
-    iplc_sim_push_pipeline_stage();
-
-    pipeline[FETCH].itype = SW;
-    pipeline[FETCH].instruction_address = instruction_address;
+static inline void counter_train(uint8_t *counter, int taken) {
+    if (taken && *counter < 3)
+        (*counter)++;
+    else if (!taken && *counter > 0)
+        (*counter)--;
+}
 
-    pipeline[FETCH].stage.sw.data_address = data_address;
-    pipeline[FETCH].stage.sw.src_reg = src_reg;
-    pipeline[FETCH].stage.sw.base_reg = base_reg;
+static int static_predict(predictor_t *pred, unsigned int address) {
+    return pred->static_taken;
+}
 
-    inst_stats.sw++;
+static void static_update(predictor_t *pred, unsigned int address, int taken) {
 }
 
-void iplc_sim_process_pipeline_branch(int reg1, int reg2)
-{
-    /* You must implement this function */
-    iplc_sim_push_pipeline_stage();
+static int bimodal_predict(predictor_t *pred, unsigned int address) {
+    return pred->counters[predictor_index(address, pred->bits)] >= 2;
+}
 
-    pipeline[FETCH].itype = BRANCH;
-    pipeline[FETCH].instruction_address = instruction_address;
+static void bimodal_update(predictor_t *pred, unsigned int address, int taken) {
+    counter_train(&pred->counters[predictor_index(address, pred->bits)], taken);
+}
 
-    pipeline[FETCH].stage.branch.reg1 = reg1;
-    pipeline[FETCH].stage.branch.reg2 = reg2;
+static inline uint32_t gshare_index(predictor_t *pred, unsigned int address) {
+    return predictor_index(address, pred->bits) ^ (pred->history & ((1u << pred->history_bits) - 1));
+}
 
-    inst_stats.branch++;
+static int gshare_predict(predictor_t *pred, unsigned int address) {
+    return pred->counters[gshare_index(pred, address)] >= 2;
 }
 
-void iplc_sim_process_pipeline_jump(char *instruction)
-{
-    /* You must implement this function */
-    iplc_sim_push_pipeline_stage();
+static void gshare_update(predictor_t *pred, unsigned int address, int taken) {
+    counter_train(&pred->counters[gshare_index(pred, address)], taken);
+}
 
-    pipeline[FETCH].itype = JUMP;
-    pipeline[FETCH].instruction_address = instruction_address;
+static inline uint8_t* tournament_local(predictor_t *pred, unsigned int address) {
+    uint32_t history = pred->local_history[predictor_index(address, pred->bits)];
 
-    strcpy(pipeline[FETCH].stage.jump.instruction, instruction);
+    return &pred->local[history & ((1u << pred->history_bits) - 1)];
+}
 
-    inst_stats.jump++;
+static inline uint32_t tournament_global(predictor_t *pred) {
+    return pred->history & ((1u << pred->history_bits) - 1);
 }
 
-void iplc_sim_process_pipeline_syscall()
-{
-    /* You must implement this function */
-    iplc_sim_push_pipeline_stage();
+static int tournament_predict(predictor_t *pred, unsigned int address) {
+    uint32_t global = tournament_global(pred);
 
-    pipeline[FETCH].itype = SYSCALL;
-    pipeline[FETCH].instruction_address = instruction_address;
+    if (pred->chooser[global] >= 2)
+        return pred->counters[global] >= 2;
+    return *tournament_local(pred, address) >= 2;
+}
 
-    inst_stats.syscall++;
+static void tournament_update(predictor_t *pred, unsigned int address, int taken) {
+    uint32_t global = tournament_global(pred);
+    uint32_t *history = &pred->local_history[predictor_index(address, pred->bits)];
+    uint8_t *local = tournament_local(pred, address);
+    int local_right = (*local >= 2) == taken;
+    int global_right = (pred->counters[global] >= 2) == taken;
+
+    // The chooser only learns from branches where the two disagree
+    if (local_right != global_right)
+        counter_train(&pred->chooser[global], global_right);
+    pred->local_correct += local_right;
+    pred->global_correct += global_right;
+
+    counter_train(local, taken);
+    counter_train(&pred->counters[global], taken);
+    *history = (*history << 1) | taken;
 }
 
-void iplc_sim_process_pipeline_nop()
-{
-    /* You must implement this function */
-    iplc_sim_push_pipeline_stage();
+const predictor_ops_t predictor_ops[PRED_COUNT] = {
+    [PRED_STATIC]     = {"static",     static_predict,     static_update},
+    [PRED_BIMODAL]    = {"bimodal",    bimodal_predict,    bimodal_update},
+    [PRED_GSHARE]     = {"gshare",     gshare_predict,     gshare_update},
+    [PRED_TOURNAMENT] = {"tournament", tournament_predict, tournament_update},
+};
 
-    pipeline[FETCH].itype = NOP;
-    pipeline[FETCH].instruction_address = instruction_address;
+// Look a predictor up by name, -1 if there is no such predictor
+int iplc_sim_predictor_kind(const char *name) {
+    int i;
 
-    inst_stats.nop++;
+    for (i = 0; i < PRED_COUNT; i++) {
+        if (strcmp(predictor_ops[i].name, name) == 0)
+            return i;
+    }
+    return -1;
 }
 
+static void* iplc_sim_predictor_table(size_t entries, size_t size) {
+    void *table = calloc(entries, size);
 
+    if (table == NULL) {
+        printf("Out of memory allocating the branch predictor \n");
+        exit(-1);
+    }
+    return table;
+}
 
-//*****Parsing Function*****//
-// Don't touch this function.  It is for parsing the instruction stream.
-unsigned int iplc_sim_parse_reg(char *reg_str) {
-    int i;
-    
-    // Turn comma into \n
-    if (reg_str[strlen(reg_str)-1] == ',')
-        reg_str[strlen(reg_str)-1] = '\n';
-    
-    if (reg_str[0] != '$')
-        return atoi(reg_str);
-    else {
-        // Copy down over $ character than return atoi
-        for (i = 0; i < strlen(reg_str); i++)
-            reg_str[i] = reg_str[i+1];
-        
-        return atoi(reg_str);
+// Every counter starts out weakly not taken and the chooser weakly local
+static void iplc_sim_predictor_clear(predictor_t *pred) {
+    size_t entries = 1ul << pred->bits;
+    size_t patterns = 1ul << pred->history_bits;
+
+    pred->history = 0;
+    if (pred->counters)
+        memset(pred->counters, 1, (pred->ops == &predictor_ops[PRED_TOURNAMENT]) ? patterns : entries);
+    if (pred->local) {
+        memset(pred->local, 1, patterns);
+        memset(pred->local_history, 0, entries * sizeof(uint32_t));
+        memset(pred->chooser, 1, patterns);
     }
+    if (pred->btb_bits)
+        memset(pred->btb_tag, 0, (1ul << pred->btb_bits) * sizeof(uint32_t));
+
+    pred->predictions = 0;
+    pred->correct = 0;
+    pred->local_correct = 0;
+    pred->global_correct = 0;
+    pred->btb_lookups = 0;
+    pred->btb_hits = 0;
+    pred->mispredict_cycles = 0;
 }
 
-// Don't touch this function.  It is for parsing the instruction stream.
-void iplc_sim_parse_instruction(char *buffer) {
-    int instruction_hit = 0;
-    int i = 0, j = 0;
-    int src_reg = 0;
-    int src_reg2 = 0;
-    int dest_reg = 0;
-    char str_src_reg[16];
-    char str_src_reg2[16];
-    char str_dest_reg[16];
-    char str_constant[16];
-    
-    if (sscanf(buffer, "%x %s", &instruction_address, instruction ) != 2) {
-        printf("Malformed instruction \n");
+// Set the predictor up, reporting its configuration unless it is the plain static one
+static void iplc_sim_predictor_init(sim_t *sim) {
+    const sim_config_t *config = &sim->config;
+    predictor_t *pred = &sim->predictor;
+    int kind = config->predictor;
+
+    pred->ops = &predictor_ops[kind];
+    pred->static_taken = sim->branch_predict_taken;
+    pred->bits = config->predictor_bits ? config->predictor_bits : PREDICTOR_BITS;
+    pred->history_bits = config->history_bits ? config->history_bits : pred->bits;
+    pred->btb_bits = config->btb_bits;
+
+    if (pred->bits < 1 || pred->bits > PREDICTOR_MAX_BITS || pred->history_bits < 1 ||
+        pred->history_bits > PREDICTOR_MAX_BITS || pred->btb_bits < 0 || pred->btb_bits > PREDICTOR_MAX_BITS) {
+        printf("Branch predictor tables take between 1 and %d index bits \n", PREDICTOR_MAX_BITS);
         exit(-1);
     }
-    
-    instruction_hit = iplc_sim_trap_address( instruction_address );
-    
-    // if a MISS, then push current instruction thru pipeline
-    if (!instruction_hit) {
-        // need to subtract 1, since the stage is pushed once more for actual instruction processing
-        // also need to allow for a branch miss prediction during the fetch cache miss time -- by
-        // counting cycles this allows for these cycles to overlap and not doubly count.
-        
-        printf("INST MISS:\t Address 0x%x \n", instruction_address);
-        
-        for (i = pipeline_cycles, j = pipeline_cycles; i < j + CACHE_MISS_DELAY - 1; i++)
-            iplc_sim_push_pipeline_stage();
+    if (kind == PRED_GSHARE && pred->history_bits > pred->bits) {
+        printf("gshare can't keep more history bits than its %d index bits \n", pred->bits);
+        exit(-1);
     }
-    else
-        printf("INST HIT:\t Address 0x%x \n", instruction_address);
-    
-    // Parse the Instruction
-    if (strncmp(instruction, "add", 3 ) == 0 ||
-        strncmp(instruction, "sll", 3 ) == 0 ||
-        strncmp(instruction, "ori", 3 ) == 0) {
-        if (sscanf(buffer, "%x %s %s %s %s",
-                   &instruction_address,
-                   instruction,
-                   str_dest_reg,
-                   str_src_reg,
-                   str_src_reg2 ) != 5) {
-            printf("Malformed RTYPE instruction (%s) at address 0x%x \n",
-                   instruction, instruction_address);
-            exit(-1);
-        }
-        
-        dest_reg = iplc_sim_parse_reg(str_dest_reg);
-        src_reg = iplc_sim_parse_reg(str_src_reg);
-        src_reg2 = iplc_sim_parse_reg(str_src_reg2);
-        
-        iplc_sim_process_pipeline_rtype(instruction, dest_reg, src_reg, src_reg2);
+
+    if (kind == PRED_BIMODAL || kind == PRED_GSHARE)
+        pred->counters = (uint8_t*) iplc_sim_predictor_table(1ul << pred->bits, 1);
+    if (kind == PRED_TOURNAMENT) {
+        pred->counters = (uint8_t*) iplc_sim_predictor_table(1ul << pred->history_bits, 1);
+        pred->local = (uint8_t*) iplc_sim_predictor_table(1ul << pred->history_bits, 1);
+        pred->local_history = (uint32_t*) iplc_sim_predictor_table(1ul << pred->bits, sizeof(uint32_t));
+        pred->chooser = (uint8_t*) iplc_sim_predictor_table(1ul << pred->history_bits, 1);
+    }
+    if (pred->btb_bits) {
+        pred->btb_tag = (uint32_t*) iplc_sim_predictor_table(1ul << pred->btb_bits, sizeof(uint32_t));
+        pred->btb_target = (uint32_t*) iplc_sim_predictor_table(1ul << pred->btb_bits, sizeof(uint32_t));
+    }
+    iplc_sim_predictor_clear(pred);
+
+    if (kind == PRED_STATIC && !pred->btb_bits)
+        return;
+
+    fprintf(sim->out, "Branch Predictor Configuration \n");
+    if (kind == PRED_STATIC)
+        fprintf(sim->out, "   Predictor: static %s \n", pred->static_taken ? "taken" : "not taken");
+    else
+        fprintf(sim->out, "   Predictor: %s \n", pred->ops->name);
+    if (kind == PRED_BIMODAL || kind == PRED_GSHARE)
+        fprintf(sim->out, "   Counters: %lu \n", 1ul << pred->bits);
+    if (kind == PRED_TOURNAMENT)
+        fprintf(sim->out, "   Local Histories: %lu \n", 1ul << pred->bits);
+    if (kind == PRED_GSHARE || kind == PRED_TOURNAMENT)
+        fprintf(sim->out, "   History Bits: %d \n", pred->history_bits);
+    if (pred->btb_bits)
+        fprintf(sim->out, "   BTB Entries: %lu \n", 1ul << pred->btb_bits);
+}
+
+static void iplc_sim_predictor_free(predictor_t *pred) {
+    free(pred->counters);
+    free(pred->local);
+    free(pred->local_history);
+    free(pred->chooser);
+    free(pred->btb_tag);
+    free(pred->btb_target);
+}
+
+/*  Train the predictor on what the branch at address did without counting
+    a prediction, which is all warming between samples does. */
+void iplc_sim_train_branch(sim_t *sim, unsigned int address, int taken, unsigned int target) {
+    predictor_t *pred = &sim->predictor;
+
+    if (pred->btb_bits && taken) {
+        uint32_t entry = predictor_index(address, pred->btb_bits);
+
+        pred->btb_tag[entry] = address;
+        pred->btb_target[entry] = target;
+    }
+
+    pred->ops->update(pred, address, taken);
+    pred->history = (pred->history << 1) | taken;
+}
+
+/*  Predict the branch at address, then train the predictor on what it did.
+    A taken prediction also needs the target from the branch target buffer
+    when there is one. Returns 1 if the prediction was right. */
+int iplc_sim_predict_branch(sim_t *sim, unsigned int address, int taken, unsigned int target) {
+    predictor_t *pred = &sim->predictor;
+    int predicted = pred->ops->predict(pred, address);
+    int correct = (predicted == taken);
+
+    if (pred->btb_bits && predicted) {
+        uint32_t entry = predictor_index(address, pred->btb_bits);
+        int hit = (pred->btb_tag[entry] == address);
+
+        pred->btb_lookups++;
+        pred->btb_hits += hit;
+        if (taken && (!hit || pred->btb_target[entry] != target))
+            correct = 0;
+    }
+
+    iplc_sim_train_branch(sim, address, taken, target);
+    pred->predictions++;
+    pred->correct += correct;
+    return correct;
+}
+
+
+
+//*****Simulator Function Implementations*****//
+// Allocate a simulator for the given configuration, ready to accept instructions
+sim_t* iplc_sim_create(const sim_config_t *config, FILE *out) {
+    sim_t *sim = (sim_t*) calloc(1, sizeof(sim_t));
+
+    if (sim == NULL) {
+        printf("Out of memory allocating simulator \n");
+        exit(-1);
+    }
+
+    sim->config = *config;
+    sim->branch_predict_taken = config->branch_predict_taken;
+    sim->dump_pipeline = 1;
+    sim->out = out;
+
+    iplc_sim_init(sim);
+    return sim;
+}
+
+// Configure one cache, reporting its configuration under the given title
+static void iplc_sim_cache_init(sim_t *sim, cache_t *cache, const char *title,
+                                int index, int blocksize, int assoc, int replacement) {
+    unsigned long cache_size = 0;
+
+    // before the shift below, and before the configuration is reported as if it were fine
+    if (index < 0 || index > CACHE_MAX_INDEX) {
+        printf("Index must be between 0 and %d bits \n", CACHE_MAX_INDEX);
+        exit(-1);
+    }
+
+    if (assoc < 1 || assoc > CACHE_MAX_ASSOC) {
+        printf("Associativity must be between 1 and %d \n", CACHE_MAX_ASSOC);
+        exit(-1);
+    }
+
+    if (replacement == REPL_TREE_PLRU && (assoc & (assoc - 1)) != 0) {
+        printf("tree-plru needs a power of two associativity \n");
+        exit(-1);
+    }
+
+    cache->index = index;
+    cache->blocksize = blocksize;
+    cache->assoc = assoc;
+    cache->replacement = &replacement_ops[replacement];
+    cache->rng = sim->config.seed ? sim->config.seed : 1;
+    cache->profile = sim->config.profile;
+    
+    cache->blockoffsetbits = iplc_sim_cache_blockoffsetbits(blocksize);
+    
+    cache_size = assoc * (1ul << index) * ((32 * blocksize) + 33 - index - cache->blockoffsetbits);
+    
+    fprintf(sim->out, "%s \n", title);
+    fprintf(sim->out, "   Index: %d bits or %d lines \n", cache->index, (1 << cache->index));
+    fprintf(sim->out, "   BlockSize: %d \n", cache->blocksize);
+    fprintf(sim->out, "   Associativity: %d \n", cache->assoc);
+    fprintf(sim->out, "   BlockOffSetBits: %d \n", cache->blockoffsetbits);
+    fprintf(sim->out, "   CacheSize: %lu \n", cache_size);
+    fprintf(sim->out, "   Replacement: %s \n", cache->replacement->name);
+    
+    // Inclusive and exclusive hierarchies move lines by address between levels
+    cache->lines = sim->config.levels > 0 && sim->config.inclusion != INCLUSION_NINE;
+
+    // Lay the sets out back to back, none of them straddling a host cache line
+    cache->ways = (assoc < CACHE_TAG_LANES) ? assoc : (assoc + CACHE_TAG_LANES - 1) / CACHE_TAG_LANES * CACHE_TAG_LANES;
+    cache->repl_offset = sizeof(uint64_t) + sizeof(uint32_t) * cache->ways * (cache->lines ? 2 : 1);
+    cache->repl_offset = (cache->repl_offset + cache->replacement->state_align - 1) /
+                         cache->replacement->state_align * cache->replacement->state_align;
+    cache->set_bytes = cache->repl_offset + cache->replacement->state_bytes(assoc);
+    if (cache->set_bytes <= CACHE_LINE_BYTES)
+        cache->set_bytes = 1ul << (64 - __builtin_clzl(cache->set_bytes - 1));
+    else
+        cache->set_bytes = (cache->set_bytes + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+
+    /*  Anonymous memory comes zeroed a page at a time on first touch, so even
+        a cache of millions of sets is allocated in no time. */
+    cache->sets = (uint8_t*) mmap(NULL, cache->set_bytes << index, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cache->sets == MAP_FAILED) {
+        printf("Out of memory allocating cache \n");
+        exit(-1);
+    }
+#ifdef MADV_HUGEPAGE
+    if ((cache->set_bytes << index) >= CACHE_LAZY_BYTES)
+        madvise(cache->sets, cache->set_bytes << index, MADV_HUGEPAGE);
+#endif
+}
+
+// Give a cache's memory back
+static void iplc_sim_cache_free(cache_t *cache) {
+    if (cache->sets != NULL)
+        munmap(cache->sets, cache->set_bytes << cache->index);
+}
+
+// Empty a cache and restart its random stream and statistics
+static void iplc_sim_cache_reset(sim_t *sim, cache_t *cache) {
+    // Dropping the pages of a big cache is cheaper than clearing them, they come back zeroed
+    if ((cache->set_bytes << cache->index) >= CACHE_LAZY_BYTES)
+        madvise(cache->sets, cache->set_bytes << cache->index, MADV_DONTNEED);
+    else
+        bzero(cache->sets, cache->set_bytes << cache->index);
+    cache->rng = sim->config.seed ? sim->config.seed : 1;
+    cache->access = 0;
+    cache->hit = 0;
+    cache->miss = 0;
+}
+
+// Correctly configure the cache
+void iplc_sim_init(sim_t *sim) {
+    int i;
+    sim_config_t *config = &sim->config;
+    char title[32];
+
+    iplc_sim_cache_init(sim, &sim->cache, "Cache Configuration",
+                        config->index, config->blocksize, config->assoc, config->replacement);
+
+    if (config->data_cache == DCACHE_SPLIT) {
+        iplc_sim_cache_init(sim, &sim->dcache, "Data Cache Configuration",
+                            config->data_index ? config->data_index : config->index,
+                            config->data_blocksize ? config->data_blocksize : config->blocksize,
+                            config->data_assoc ? config->data_assoc : config->assoc,
+                            config->replacement);
+    }
+    else if (config->data_cache == DCACHE_UNIFIED) {
+        fprintf(sim->out, "   Unified: lw/sw data shares this cache \n");
+    }
+
+    if (config->levels < 0 || config->levels > CACHE_MAX_LEVELS - 1) {
+        printf("There can be at most %d cache levels below L1 \n", CACHE_MAX_LEVELS - 1);
+        exit(-1);
+    }
+
+    for (i = 0; i < config->levels; i++) {
+        const cache_level_t *level = &config->level[i];
+
+        snprintf(title, sizeof(title), "L%d Cache Configuration", i + 2);
+        iplc_sim_cache_init(sim, &sim->level[i], title, level->index, level->blocksize, level->assoc, level->replacement);
+        sim->level[i].latency = level->latency;
+        fprintf(sim->out, "   Latency: %d \n", level->latency);
+    }
+
+    sim->memory_latency = config->memory_latency ? config->memory_latency : CACHE_MISS_DELAY;
+    if (config->levels > 0) {
+        fprintf(sim->out, "Memory Hierarchy \n");
+        fprintf(sim->out, "   Inclusion: %s \n", inclusion_policies[config->inclusion]);
+        fprintf(sim->out, "   Memory Latency: %d \n", sim->memory_latency);
+    }
+
+    sim->pipeline_depth = config->depth ? config->depth : PIPELINE_DEPTH;
+    sim->branch_stage = config->branch_stage ? config->branch_stage : DECODE;
+    sim->mem_stage = config->mem_stage ? config->mem_stage : sim->pipeline_depth - 2;
+    sim->width = config->width ? config->width : 1;
+    sim->mem_ports = config->mem_ports ? config->mem_ports : 1;
+    sim->branch_units = config->branch_units ? config->branch_units : 1;
+    if (config->core != CORE_OOO && (config->depth || config->branch_stage || config->mem_stage ||
+                                     config->forwarding != FWD_LEGACY || sim->width > 1)) {
+        fprintf(sim->out, "Pipeline Configuration \n");
+        fprintf(sim->out, "   Depth: %d \n", sim->pipeline_depth);
+        fprintf(sim->out, "   Branch Stage: %d \n", sim->branch_stage);
+        fprintf(sim->out, "   Memory Stage: %d \n", sim->mem_stage);
+        fprintf(sim->out, "   Forwarding: %s \n", forwarding_modes[config->forwarding]);
+        if (sim->width > 1) {
+            fprintf(sim->out, "   Issue Width: %d \n", sim->width);
+            fprintf(sim->out, "   Memory Ports: %d \n", sim->mem_ports);
+            fprintf(sim->out, "   Branch Units: %d \n", sim->branch_units);
+        }
+    }
+
+    if (sim->width < 1 || sim->width > MAX_WIDTH || sim->mem_ports < 1 || sim->branch_units < 1) {
+        printf("Issue width must be between 1 and %d, with at least one memory port and branch unit \n",
+               MAX_WIDTH);
+        exit(-1);
+    }
+
+    if (sim->pipeline_depth < 4 || sim->pipeline_depth > MAX_STAGES) {
+        printf("Pipeline depth must be between 4 and %d \n", MAX_STAGES);
+        exit(-1);
+    }
+
+    // ALU sits right before MEM, and neither MEM nor branch resolution can be FETCH or WRITEBACK
+    if (sim->branch_stage < 1 || sim->branch_stage > sim->pipeline_depth - 2 ||
+        sim->mem_stage < 2 || sim->mem_stage > sim->pipeline_depth - 2) {
+        printf("Branch stage must be between 1 and %d, memory stage between 2 and %d \n",
+               sim->pipeline_depth - 2, sim->pipeline_depth - 2);
+        exit(-1);
+    }
+    
+    iplc_sim_predictor_init(sim);
+    if (config->core == CORE_OOO)
+        iplc_sim_ooo_init(sim);
+    if (config->hotspots)
+        iplc_sim_attribution_init(sim);
+
+    sim->sample_period = config->sample_period;
+    sim->sample_window = config->sample_window ? config->sample_window : SAMPLE_WINDOW;
+    sim->sample_warmup = config->sample_warmup ? config->sample_warmup : SAMPLE_WARMUP;
+    sim->sample_start = -1;
+    if (sim->sample_period) {
+        fprintf(sim->out, "Sampling Configuration \n");
+        fprintf(sim->out, "   Period: %ld \n", sim->sample_period);
+        fprintf(sim->out, "   Window: %ld \n", sim->sample_window);
+        fprintf(sim->out, "   Warmup: %ld \n", sim->sample_warmup);
+
+        if (sim->sample_window < 1 || sim->sample_warmup < 0 ||
+            sim->sample_window + sim->sample_warmup > sim->sample_period) {
+            printf("A sample's warmup and window have to fit in its period \n");
+            exit(-1);
+        }
+    }
+
+    // Init the pipeline -- set all data to zero and instructions to NOP
+    for (i = 0; i < MAX_STAGES; i++) {
+        // itype is set to O which is NOP type instruction
+        bzero(&(sim->pipeline[i]), sizeof(sim->pipeline[i]));
+    }
+    sim->pipeline_head = 0;
+
+    iplc_sim_events_open(sim);
+    if (config->interval)
+        iplc_sim_interval_open(sim);
+}
+
+/*  Bring the simulator back to the state iplc_sim_init() left it in: empty
+    caches, an empty pipeline and every counter zeroed. The configuration is kept. */
+void iplc_sim_reset(sim_t *sim) {
+    int i;
+
+    iplc_sim_cache_reset(sim, &sim->cache);
+    if (sim->config.data_cache == DCACHE_SPLIT)
+        iplc_sim_cache_reset(sim, &sim->dcache);
+    for (i = 0; i < sim->config.levels; i++)
+        iplc_sim_cache_reset(sim, &sim->level[i]);
+
+    for (i = 0; i < MAX_STAGES; i++) {
+        bzero(&(sim->pipeline[i]), sizeof(sim->pipeline[i]));
+    }
+    sim->pipeline_head = 0;
+    iplc_sim_predictor_clear(&sim->predictor);
+    if (sim->ooo != NULL)
+        iplc_sim_ooo_reset(sim);
+    iplc_sim_attribution_reset(sim);
+
+    bzero(sim->ready, sizeof(sim->ready));
+    sim->pending = 0;
+    sim->pending_loads = 0;
+    sim->hazard_clock = 0;
+    sim->held = 0;
+    sim->hazard_stalls = 0;
+    sim->load_use_stalls = 0;
+
+    sim->cache_miss = 0;
+    sim->cache_access = 0;
+    sim->cache_hit = 0;
+    sim->data_miss = 0;
+    sim->data_access = 0;
+    sim->data_hit = 0;
+    sim->miss_cycles = 0;
+    sim->memory_cycles = 0;
+    sim->fetch_memory_cycles = 0;
+
+    sim->instruction_address = 0;
+    sim->pipeline_cycles = 0;
+    sim->instruction_count = 0;
+    sim->branch_count = 0;
+    sim->correct_branch_predictions = 0;
+
+    sim->sample_records = 0;
+    sim->sample_start = -1;
+    sim->warm_branch = 0;
+    sim->warming = 0;
+    sim->warmed = 0;
+    sim->samples = 0;
+    sim->sample_cpi = 0;
+    sim->sample_cpi_squares = 0;
+
+    bzero(&sim->inst_stats, sizeof(inst_stats_t));
+    if (sim->interval_ring != NULL)
+        iplc_sim_interval_start(sim);
+}
+
+/*  The configuration the simulator actually runs, every setting left at 0
+    for its default replaced by the value iplc_sim_init() gave it. Settings
+    the run has no use for, the out-of-order core's without one or the data
+    cache geometry without a split data cache, are left as they were given. */
+void iplc_sim_effective_config(const sim_t *sim, sim_config_t *config) {
+    const predictor_t *pred = &sim->predictor;
+    int i;
+
+    *config = sim->config;
+    config->seed = sim->config.seed ? sim->config.seed : 1;
+    if (config->data_cache == DCACHE_SPLIT) {
+        config->data_index = sim->dcache.index;
+        config->data_blocksize = sim->dcache.blocksize;
+        config->data_assoc = sim->dcache.assoc;
+    }
+    config->memory_latency = sim->memory_latency;
+    config->depth = sim->pipeline_depth;
+    config->branch_stage = sim->branch_stage;
+    config->mem_stage = sim->mem_stage;
+    config->predictor_bits = pred->bits;
+    config->history_bits = pred->history_bits;
+    config->width = sim->width;
+    config->mem_ports = sim->mem_ports;
+    config->branch_units = sim->branch_units;
+    if (sim->ooo != NULL) {
+        config->rob_size = sim->ooo->rob_size;
+        config->iq_size = sim->ooo->iq_size;
+        config->lsq_size = sim->ooo->lsq_size;
+        for (i = 0; i < FU_COUNT; i++)
+            config->fu_latency[i] = sim->ooo->latency[i];
+    }
+    if (sim->sample_period) {
+        config->sample_window = sim->sample_window;
+        config->sample_warmup = sim->sample_warmup;
+    }
+}
+
+void iplc_sim_destroy(sim_t *sim) {
+    int i;
+
+    // The sets of each cache all live in its one allocation
+    iplc_sim_cache_free(&sim->cache);
+    iplc_sim_cache_free(&sim->dcache);
+    for (i = 0; i < sim->config.levels; i++)
+        iplc_sim_cache_free(&sim->level[i]);
+    iplc_sim_predictor_free(&sim->predictor);
+    iplc_sim_ooo_free(sim);
+    iplc_sim_attribution_free(sim);
+    iplc_sim_events_close(sim);
+    iplc_sim_interval_close(sim);
+    free(sim);
+}
+
+
+
+//*****Event Tracing*****//
+static const char* iplc_sim_stage_name(sim_t *sim, int stage, char *buffer, size_t size);
+
+// Format one event the way the simulator has always printed it
+static void iplc_sim_event_text(sim_t *sim, FILE *file, const event_t *event) {
+    char name[16];
+    int stage, lane;
+
+    switch (event->type) {
+        case EVENT_FETCH_HIT:
+            fprintf(file, "INST HIT:\t Address 0x%x \n", event->address);
+            break;
+        case EVENT_FETCH_MISS:
+            fprintf(file, "INST MISS:\t Address 0x%x \n", event->address);
+            break;
+        case EVENT_DATA_HIT:
+            fprintf(file, "DATA HIT:\t Address 0x%x \n", event->address);
+            break;
+        case EVENT_DATA_MISS:
+            fprintf(file, "DATA MISS:\t Address 0x%x \n", event->address);
+            break;
+        case EVENT_PIPELINE:
+            stage = event->arg & 0xff;
+            lane = event->arg >> 8;
+            if (stage == FETCH && lane == 0)
+                fprintf(file, "(cyc: %u) ", event->cycle);
+            if (lane == 0)
+                fprintf(file, "%s:\t", iplc_sim_stage_name(sim, stage, name, sizeof(name)));
+            fprintf(file, " %d: 0x%x ", event->itype, event->address);
+            if (lane == sim->width - 1)
+                fprintf(file, "%s", (stage == sim->pipeline_depth - 1) ? "\n" : "\t");
+            break;
+        case EVENT_RETIRE:
+            fprintf(file, "RETIRE:\t Address 0x%x, Type %d, at Time %u \n",
+                    event->address, event->itype, event->cycle);
+            break;
+        case EVENT_STALL:
+            fprintf(file, "STALL:\t Address 0x%x, %d cycles at Time %u \n",
+                    event->address, event->arg, event->cycle);
+            break;
+        case EVENT_MISPREDICT:
+            fprintf(file, "MISPREDICT:\t Address 0x%x, %d cycles at Time %u \n",
+                    event->address, event->arg, event->cycle);
+            break;
+    }
+}
+
+/*  The sink's thread: drains the ring until the simulator closes it. The
+    binary sink writes each contiguous run of the ring with one fwrite. */
+static void* iplc_sim_event_writer(void *arg) {
+    sim_t *sim = (sim_t*) arg;
+    event_ring_t *ring = sim->ring;
+    struct timespec idle = {0, 50000};
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head, first, n;
+
+    for (;;) {
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (head == tail) {
+            // head can't move once stop is set, so one more look settles it
+            if (atomic_load_explicit(&ring->stop, memory_order_acquire)) {
+                if (atomic_load_explicit(&ring->head, memory_order_acquire) == tail)
+                    break;
+                continue;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        if (sim->config.event_sink == EVENT_SINK_BINARY) {
+            first = tail & (EVENT_RING_SIZE - 1);
+            n = head - tail;
+            if (first + n > EVENT_RING_SIZE)
+                n = EVENT_RING_SIZE - first;
+            fwrite(&ring->events[first], sizeof(event_t), n, ring->file);
+            tail += n;
+        } else {
+            for (; tail != head; tail++)
+                iplc_sim_event_text(sim, ring->file, &ring->events[tail & (EVENT_RING_SIZE - 1)]);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return NULL;
+}
+
+/*  Queue an event for the sink, the slow half of iplc_sim_event(). Events
+    are never dropped, a full ring makes the simulator wait for the writer. */
+void iplc_sim_event_push(sim_t *sim, int type, unsigned int address, int itype, int arg) {
+    event_ring_t *ring = sim->ring;
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    event_t *event;
+
+    while (head - ring->free_tail == EVENT_RING_SIZE) {
+        ring->free_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->free_tail == EVENT_RING_SIZE)
+            sched_yield();
+    }
+
+    event = &ring->events[head & (EVENT_RING_SIZE - 1)];
+    event->cycle = sim->pipeline_cycles;
+    event->address = address;
+    event->type = (uint16_t) type;
+    event->itype = (uint16_t) itype;
+    event->arg = arg;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/*  Start tracing the events the configuration asks for. Text goes to the
+    report unless there is an event file, which the binary sink needs. */
+void iplc_sim_events_open(sim_t *sim) {
+    const sim_config_t *config = &sim->config;
+    event_ring_t *ring;
+
+    sim->events = 0;
+    sim->ring = NULL;
+#ifdef IPLC_SIM_NO_EVENTS
+    return;
+#endif
+    if (config->event_sink == EVENT_SINK_NONE)
+        return;
+
+    if (config->event_sink == EVENT_SINK_BINARY && config->event_file == NULL) {
+        printf("The binary event sink needs an event file \n");
+        exit(-1);
+    }
+
+    ring = (event_ring_t*) aligned_alloc(_Alignof(event_ring_t), sizeof(event_ring_t));
+    if (ring == NULL) {
+        printf("Out of memory allocating the event ring \n");
+        exit(-1);
+    }
+    memset(ring, 0, sizeof(event_ring_t));
+
+    ring->events = (event_t*) malloc(EVENT_RING_SIZE * sizeof(event_t));
+    if (ring->events == NULL) {
+        printf("Out of memory allocating the event ring \n");
+        exit(-1);
+    }
+
+    ring->file = sim->out;
+    if (config->event_file != NULL) {
+        ring->file = fopen(config->event_file, (config->event_sink == EVENT_SINK_BINARY) ? "wb" : "w");
+        if (ring->file == NULL) {
+            printf("fopen failed for %s file\n", config->event_file);
+            exit(-1);
+        }
+        ring->owns_file = 1;
+    }
+
+    sim->ring = ring;
+    sim->events = config->events ? config->events : EVENTS_DEFAULT;
+    if (pthread_create(&ring->writer, NULL, iplc_sim_event_writer, sim) != 0) {
+        printf("pthread_create failed for the event writer \n");
+        exit(-1);
+    }
+}
+
+// Stop tracing, once the writer has drained every queued event
+void iplc_sim_events_close(sim_t *sim) {
+    event_ring_t *ring = sim->ring;
+
+    if (ring == NULL)
+        return;
+
+    atomic_store_explicit(&ring->stop, 1, memory_order_release);
+    pthread_join(ring->writer, NULL);
+    if (ring->owns_file)
+        fclose(ring->file);
+
+    free(ring->events);
+    free(ring);
+    sim->ring = NULL;
+    sim->events = 0;
+}
+
+
+
+//*****Miss Attribution*****//
+/*  -hotspots keeps the misses of every instruction in pc_table_t and the
+    traffic of every L1 set in the cache's set_stats, and reports the worst
+    of them with the rest of the report. */
+
+// Bucket of an instruction address in a table of mask + 1 entries
+static inline uint32_t iplc_sim_pc_hash(uint32_t address, uint32_t mask) {
+    uint32_t h = address >> 2;
+
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h & mask;
+}
+
+// Allocate an empty table of capacity entries, a power of two
+static void iplc_sim_pc_table_init(pc_table_t *table, uint32_t capacity) {
+    table->entries = (pc_stats_t*) calloc(capacity, sizeof(pc_stats_t));
+    if (table->entries == NULL) {
+        printf("Out of memory allocating the miss attribution table \n");
+        exit(-1);
+    }
+    table->mask = capacity - 1;
+    table->count = 0;
+}
+
+// The entry of an instruction, claiming a free one if it hasn't missed before
+static pc_stats_t* iplc_sim_pc_table_find(pc_table_t *table, uint32_t address) {
+    uint32_t i = iplc_sim_pc_hash(address, table->mask);
+
+    while (table->entries[i].misses != 0 && table->entries[i].address != address)
+        i = (i + 1) & table->mask;
+    table->entries[i].address = address;
+    return &table->entries[i];
+}
+
+/*  Charge a miss and the cycles it took to the instruction at address,
+    doubling the table once it is three quarters full. */
+void iplc_sim_attribute_miss(sim_t *sim, unsigned int address, int cycles) {
+    pc_table_t *table = &sim->pc_stats;
+    pc_stats_t *entry;
+    pc_table_t grown;
+    uint32_t i;
+
+    if ((table->count + 1) * 4 > (table->mask + 1) * 3) {
+        iplc_sim_pc_table_init(&grown, (table->mask + 1) * 2);
+        for (i = 0; i <= table->mask; i++) {
+            if (table->entries[i].misses != 0)
+                *iplc_sim_pc_table_find(&grown, table->entries[i].address) = table->entries[i];
+        }
+        grown.count = table->count;
+        free(table->entries);
+        *table = grown;
+    }
+
+    entry = iplc_sim_pc_table_find(table, address);
+    table->count += (entry->misses == 0);
+    entry->misses++;
+    entry->stall_cycles += cycles;
+}
+
+// Start counting per instruction and per set, the L1 caches have to be set up
+void iplc_sim_attribution_init(sim_t *sim) {
+    iplc_sim_pc_table_init(&sim->pc_stats, ATTRIBUTION_PCS);
+
+    sim->cache.set_stats = (set_stats_t*) calloc(1ul << sim->cache.index, sizeof(set_stats_t));
+    if (sim->config.data_cache == DCACHE_SPLIT)
+        sim->dcache.set_stats = (set_stats_t*) calloc(1ul << sim->dcache.index, sizeof(set_stats_t));
+    if (sim->cache.set_stats == NULL || (sim->config.data_cache == DCACHE_SPLIT && sim->dcache.set_stats == NULL)) {
+        printf("Out of memory allocating the miss attribution table \n");
+        exit(-1);
+    }
+}
+
+// Forget everything counted so far
+void iplc_sim_attribution_reset(sim_t *sim) {
+    if (sim->pc_stats.entries == NULL)
+        return;
+
+    bzero(sim->pc_stats.entries, (sim->pc_stats.mask + 1ul) * sizeof(pc_stats_t));
+    sim->pc_stats.count = 0;
+    bzero(sim->cache.set_stats, (1ul << sim->cache.index) * sizeof(set_stats_t));
+    if (sim->dcache.set_stats != NULL)
+        bzero(sim->dcache.set_stats, (1ul << sim->dcache.index) * sizeof(set_stats_t));
+}
+
+void iplc_sim_attribution_free(sim_t *sim) {
+    free(sim->pc_stats.entries);
+    free(sim->cache.set_stats);
+    free(sim->dcache.set_stats);
+}
+
+/*  Keep the n largest keys seen so far in top[]/keys[], largest first and
+    the earlier of equal keys first. count is how many are kept, returns
+    the new count. */
+static int iplc_sim_top_insert(uint32_t *top, uint64_t *keys, int n, int count, uint32_t id, uint64_t key) {
+    int i;
+
+    if (key == 0 || (count == n && key <= keys[n - 1]))
+        return count;
+
+    i = (count < n) ? count++ : n - 1;
+    for (; i > 0 && keys[i - 1] < key; i--) {
+        top[i] = top[i - 1];
+        keys[i] = keys[i - 1];
+    }
+    top[i] = id;
+    keys[i] = key;
+    return count;
+}
+
+// Print the n busiest and the n most evicted from sets of an L1 cache
+static void iplc_sim_attribution_sets(sim_t *sim, const cache_t *cache, const char *name, int n,
+                                      uint32_t *top, uint64_t *keys) {
+    const set_stats_t *stats = cache->set_stats;
+    uint32_t set, sets = 1u << cache->index;
+    long evicted = 0;
+    int i, count, pass;
+
+    for (set = 0; set < sets; set++)
+        evicted += (stats[set].evict != 0);
+
+    for (pass = 0; pass < 2; pass++) {
+        count = 0;
+        for (set = 0; set < sets; set++)
+            count = iplc_sim_top_insert(top, keys, n, count, set, pass ? stats[set].evict : stats[set].access);
+
+        if (pass == 0)
+            fprintf(sim->out, "\t Hot %s Sets (top %d of %u by accesses) \n", name, count, sets);
+        else
+            fprintf(sim->out, "\t Conflicting %s Sets (top %d of %ld that evicted a line) \n", name, count, evicted);
+        fprintf(sim->out, "\t\t %8s %12s %12s %12s %10s \n", "set", "accesses", "misses", "evictions", "miss rate");
+        for (i = 0; i < count; i++) {
+            const set_stats_t *s = &stats[top[i]];
+
+            fprintf(sim->out, "\t\t %8u %12lu %12lu %12lu %10f \n", top[i], (unsigned long) s->access,
+                    (unsigned long) s->miss, (unsigned long) s->evict, s->access ? (double) s->miss / s->access : 0);
+        }
+    }
+}
+
+// Print the instructions that missed most and the worst L1 sets
+void iplc_sim_attribution_report(sim_t *sim) {
+    const pc_table_t *table = &sim->pc_stats;
+    int n = sim->config.hotspots;
+    uint32_t *top = (uint32_t*) malloc(n * sizeof(uint32_t));
+    uint64_t *keys = (uint64_t*) malloc(n * sizeof(uint64_t));
+    long misses = sim->cache_miss + sim->data_miss;
+    uint32_t i;
+    int count = 0, j;
+
+    if (top == NULL || keys == NULL) {
+        printf("Out of memory reporting the miss attribution \n");
+        exit(-1);
+    }
+
+    fprintf(sim->out, " Miss Attribution \n");
+
+    // an instruction is kept by its slot in the table
+    for (i = 0; i <= table->mask; i++)
+        count = iplc_sim_top_insert(top, keys, n, count, i, table->entries[i].misses);
+
+    fprintf(sim->out, "\t Hot Instructions (top %d of %u that missed) \n", count, table->count);
+    fprintf(sim->out, "\t\t %10s %12s %14s %8s \n", "address", "misses", "stall cycles", "share");
+    for (j = 0; j < count; j++) {
+        const pc_stats_t *entry = &table->entries[top[j]];
+
+        fprintf(sim->out, "\t\t 0x%08x %12u %14lu %7.3f%% \n", entry->address, entry->misses,
+                (unsigned long) entry->stall_cycles, misses ? 100.0 * entry->misses / misses : 0);
+    }
+
+    iplc_sim_attribution_sets(sim, &sim->cache, (sim->config.data_cache == DCACHE_SPLIT) ? "Instruction" : "Cache",
+                              n, top, keys);
+    if (sim->config.data_cache == DCACHE_SPLIT)
+        iplc_sim_attribution_sets(sim, &sim->dcache, "Data", n, top, keys);
+    fprintf(sim->out, "\n");
+
+    free(top);
+    free(keys);
+}
+
+
+
+//*****Interval Statistics*****//
+/*  With -interval the simulator snapshots its counters every interval
+    retired instructions and queues the difference from the last snapshot
+    for a writer thread, so the file is written while the simulation goes
+    on and the simulator only ever copies a record into the ring. */
+
+// Every counter a snapshot takes, as totals for the run so far
+static void iplc_sim_interval_totals(const sim_t *sim, uint64_t *counts) {
+    const ooo_t *ooo = sim->ooo;
+
+    // the out-of-order core only settles instruction_count and pipeline_cycles once it drains
+    counts[INTERVAL_INSTRUCTIONS] = (ooo != NULL) ? (uint64_t) ooo->instructions : sim->instruction_count;
+    counts[INTERVAL_CYCLES] = (ooo != NULL) ? (ooo->instructions ? ooo->commit_cycle + 1 : 0) : sim->pipeline_cycles;
+    counts[INTERVAL_FETCHES] = sim->cache_access;
+    counts[INTERVAL_FETCH_MISSES] = sim->cache_miss;
+    counts[INTERVAL_DATA_ACCESSES] = sim->data_access;
+    counts[INTERVAL_DATA_MISSES] = sim->data_miss;
+    counts[INTERVAL_BRANCHES] = sim->branch_count;
+    counts[INTERVAL_MISPREDICTIONS] = sim->branch_count - sim->correct_branch_predictions;
+    counts[INTERVAL_FETCH_STALLS] = sim->fetch_memory_cycles;
+    counts[INTERVAL_DATA_STALLS] = sim->memory_cycles - sim->fetch_memory_cycles;
+    counts[INTERVAL_BRANCH_STALLS] = sim->predictor.mispredict_cycles;
+    counts[INTERVAL_HAZARD_STALLS] = sim->hazard_stalls;
+    counts[INTERVAL_STRUCTURAL_STALLS] = (ooo != NULL) ? ooo->rob_stalls + ooo->iq_stalls + ooo->lsq_stalls : 0;
+}
+
+static inline double iplc_sim_interval_ratio(uint64_t n, uint64_t d) {
+    return d ? (double) n / (double) d : 0;
+}
+
+// The writer's thread: drains the ring until the simulator closes it
+static void* iplc_sim_interval_writer(void *arg) {
+    interval_ring_t *ring = (interval_ring_t*) arg;
+    struct timespec idle = {0, 1000000};
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head;
+    int i;
+
+    for (;;) {
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (head == tail) {
+            // head can't move once stop is set, so one more look settles it
+            if (atomic_load_explicit(&ring->stop, memory_order_acquire)) {
+                if (atomic_load_explicit(&ring->head, memory_order_acquire) == tail)
+                    break;
+                continue;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        for (; tail != head; tail++) {
+            const interval_t *interval = &ring->intervals[tail & (INTERVAL_RING_SIZE - 1)];
+            const uint64_t *c = interval->counts;
+
+            if (ring->format == INTERVAL_BINARY) {
+                fwrite(interval, sizeof(interval_t), 1, ring->file);
+                continue;
+            }
+
+            fprintf(ring->file, "%lu,%lu,%f,%f,%f,%f", (unsigned long) interval->index, (unsigned long) interval->end,
+                    iplc_sim_interval_ratio(c[INTERVAL_CYCLES], c[INTERVAL_INSTRUCTIONS]),
+                    iplc_sim_interval_ratio(c[INTERVAL_FETCH_MISSES], c[INTERVAL_FETCHES]),
+                    iplc_sim_interval_ratio(c[INTERVAL_DATA_MISSES], c[INTERVAL_DATA_ACCESSES]),
+                    c[INTERVAL_BRANCHES] ?
+                        1.0 - iplc_sim_interval_ratio(c[INTERVAL_MISPREDICTIONS], c[INTERVAL_BRANCHES]) : 0);
+            for (i = 0; i < INTERVAL_COUNTS; i++)
+                fprintf(ring->file, ",%lu", (unsigned long) c[i]);
+            fprintf(ring->file, "\n");
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return NULL;
+}
+
+// Open the interval file and start its writer
+void iplc_sim_interval_open(sim_t *sim) {
+    const sim_config_t *config = &sim->config;
+    interval_ring_t *ring;
+    int i;
+
+    ring = (interval_ring_t*) aligned_alloc(_Alignof(interval_ring_t), sizeof(interval_ring_t));
+    if (ring == NULL) {
+        printf("Out of memory allocating the interval ring \n");
+        exit(-1);
+    }
+    memset(ring, 0, sizeof(interval_ring_t));
+
+    ring->format = config->interval_format;
+    ring->file = fopen(config->interval_file, (ring->format == INTERVAL_BINARY) ? "wb" : "w");
+    if (ring->file == NULL) {
+        printf("fopen failed for %s file\n", config->interval_file);
+        exit(-1);
+    }
+
+    if (ring->format == INTERVAL_CSV) {
+        fprintf(ring->file, "interval,end,cpi,fetch_miss_rate,data_miss_rate,branch_accuracy");
+        for (i = 0; i < INTERVAL_COUNTS; i++)
+            fprintf(ring->file, ",%s", interval_columns[i]);
+        fprintf(ring->file, "\n");
+    }
+
+    sim->interval_ring = ring;
+    iplc_sim_interval_start(sim);
+    if (pthread_create(&ring->writer, NULL, iplc_sim_interval_writer, ring) != 0) {
+        printf("pthread_create failed for the interval writer \n");
+        exit(-1);
+    }
+}
+
+/*  Take the next snapshot's differences from the counters as they stand,
+    after the simulator was reset or restored from a checkpoint. */
+void iplc_sim_interval_start(sim_t *sim) {
+    iplc_sim_interval_totals(sim, sim->interval_last);
+    sim->intervals = sim->interval_last[INTERVAL_INSTRUCTIONS] / sim->config.interval;
+    sim->interval_next = (sim->intervals + 1) * sim->config.interval;
+}
+
+/*  Queue what happened since the last snapshot. A full ring makes the
+    simulator wait, which takes a writer INTERVAL_RING_SIZE intervals behind. */
+static void iplc_sim_interval_push(sim_t *sim) {
+    interval_ring_t *ring = sim->interval_ring;
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t counts[INTERVAL_COUNTS];
+    interval_t *interval;
+    int i;
+
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == INTERVAL_RING_SIZE)
+        sched_yield();
+
+    iplc_sim_interval_totals(sim, counts);
+    interval = &ring->intervals[head & (INTERVAL_RING_SIZE - 1)];
+    interval->index = sim->intervals++;
+    interval->end = counts[INTERVAL_INSTRUCTIONS];
+    for (i = 0; i < INTERVAL_COUNTS; i++) {
+        interval->counts[i] = counts[i] - sim->interval_last[i];
+        sim->interval_last[i] = counts[i];
+    }
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Snapshot once another interval of instructions has retired, see iplc_sim_process_record()
+void iplc_sim_interval_check(sim_t *sim) {
+    uint64_t retired = (sim->ooo != NULL) ? (uint64_t) sim->ooo->instructions : sim->instruction_count;
+
+    if (retired < sim->interval_next)
+        return;
+
+    iplc_sim_interval_push(sim);
+    sim->interval_next = (retired / sim->config.interval + 1) * sim->config.interval;
+}
+
+// Snapshot what is left of the last interval, then wait for the writer to finish the file
+void iplc_sim_interval_close(sim_t *sim) {
+    interval_ring_t *ring = sim->interval_ring;
+    uint64_t counts[INTERVAL_COUNTS];
+
+    if (ring == NULL)
+        return;
+
+    iplc_sim_interval_totals(sim, counts);
+    if (counts[INTERVAL_INSTRUCTIONS] > sim->interval_last[INTERVAL_INSTRUCTIONS])
+        iplc_sim_interval_push(sim);
+
+    atomic_store_explicit(&ring->stop, 1, memory_order_release);
+    pthread_join(ring->writer, NULL);
+    fclose(ring->file);
+    free(ring);
+    sim->interval_ring = NULL;
+}
+
+
+
+//*****Profiling*****//
+const char* profile_phases[PROFILE_PHASES] = {"other", "parse", "lookup", "replacement", "pipeline"};
+const char* profile_counters[PROFILE_COUNTERS] = {"cycles", "instructions", "LLC misses", "branch misses"};
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t iplc_sim_profile_ticks(void) {
+    return __rdtsc();
+}
+
+static inline uint64_t iplc_sim_rdpmc(uint32_t counter) {
+    uint32_t low, high;
+
+    __asm__ volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+    return low | ((uint64_t) high << 32);
+}
+#else
+static inline uint64_t iplc_sim_profile_ticks(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+#endif
+
+/*  Read a counter from user space through its mmap()ed page, the way
+    perf_event_open(2) describes. Returns 0 if the counter can't be read
+    that way, which is always the case off x86. */
+static int iplc_sim_profile_rdpmc(struct perf_event_mmap_page *page, uint64_t *value) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t seq;
+    int64_t count;
+
+    do {
+        seq = page->lock;
+        __asm__ volatile("" ::: "memory");
+        if (!page->cap_user_rdpmc || page->index == 0)
+            return 0;
+        count = iplc_sim_rdpmc(page->index - 1);
+        count <<= 64 - page->pmc_width;
+        count >>= 64 - page->pmc_width; // sign extend
+        *value = page->offset + count;
+        __asm__ volatile("" ::: "memory");
+    } while (page->lock != seq);
+    return 1;
+#else
+    (void) page;
+    (void) value;
+    return 0;
+#endif
+}
+
+// Read a counter with read(2), for the totals of counters rdpmc can't reach
+static uint64_t iplc_sim_profile_read(int fd) {
+    uint64_t value = 0;
+
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value))
+        return 0;
+    return value;
+}
+
+/*  Charge the time, and the counters when they can be read per phase, since
+    the last change of phase to the phase that is running. */
+void iplc_sim_profile_charge(profile_t *profile) {
+    int phase = profile->stack[profile->depth];
+    uint64_t now = iplc_sim_profile_ticks();
+    uint64_t count;
+    int i;
+
+    profile->ticks[phase] += now - profile->last;
+    profile->last = now;
+
+    if (profile->per_phase) {
+        for (i = 0; i < PROFILE_COUNTERS; i++) {
+            if (iplc_sim_profile_rdpmc(profile->page[i], &count)) {
+                profile->counts[phase][i] += count - profile->last_count[i];
+                profile->last_count[i] = count;
+            }
+        }
+    }
+
+    if (profile->depth == PROFILE_DEPTH - 1) {
+        printf("Profile phases nested deeper than %d \n", PROFILE_DEPTH);
+        exit(-1);
+    }
+}
+
+/*  Start profiling: open the hardware counters for this thread, counting
+    user space only, and map them for rdpmc. Without perf_event_open (or
+    with perf_event_paranoid above 2) only the time is split. Hand the
+    profile to the simulator and trace reader to charge through their
+    configuration and profile field. */
+profile_t* iplc_sim_profile_start(void) {
+    static const uint64_t configs[PROFILE_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                       PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    profile_t *profile = (profile_t*) calloc(1, sizeof(profile_t));
+    struct perf_event_attr attr;
+    void *page;
+    int i;
+
+    if (profile == NULL) {
+        printf("Out of memory starting the profile \n");
+        exit(-1);
+    }
+
+    profile->per_phase = 1;
+    for (i = 0; i < PROFILE_COUNTERS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        profile->fd[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (profile->fd[i] < 0) {
+            if (profile->error == 0)
+                profile->error = errno;
+            profile->per_phase = 0;
+            continue;
+        }
+
+        page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, profile->fd[i], 0);
+        profile->page[i] = (page == MAP_FAILED) ? NULL : (struct perf_event_mmap_page*) page;
+        if (profile->page[i] == NULL || !iplc_sim_profile_rdpmc(profile->page[i], &profile->last_count[i]))
+            profile->per_phase = 0;
+        profile->start_count[i] = iplc_sim_profile_read(profile->fd[i]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &profile->start);
+    profile->start_ticks = profile->last = iplc_sim_profile_ticks();
+    return profile;
+}
+
+/*  Stop profiling and print where the time went: each phase's calls, share
+    of the time and, where they could be read per phase, its counters;
+    otherwise the counters' totals for the whole run. */
+void iplc_sim_profile_report(profile_t *profile, FILE *out) {
+    const char* padding = "--------------------------------------------------------------------------------";
+    struct timespec end;
+    uint64_t ticks = 0;
+    double seconds;
+    int i, j;
+
+    iplc_sim_profile_charge(profile);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    seconds = (end.tv_sec - profile->start.tv_sec) + (end.tv_nsec - profile->start.tv_nsec) / 1e9;
+    for (i = 0; i < PROFILE_PHASES; i++)
+        ticks += profile->ticks[i];
+
+    fprintf(out, "\n");
+    fprintf(out, "Profile (%.3f seconds, timed with %s):\n", seconds,
+#if defined(__x86_64__) || defined(__i386__)
+            "rdtsc"
+#else
+            "clock_gettime"
+#endif
+           );
+    fprintf(out, "+%.*s+%.*s+%.*s+%.*s", 13, padding, 12, padding, 10, padding, 8, padding);
+    for (j = 0; profile->per_phase && j < PROFILE_COUNTERS; j++)
+        fprintf(out, "+%.*s", 15, padding);
+    fprintf(out, "+\n");
+    fprintf(out, "| %-11s | %10s | %8s | %6s ", "phase", "calls", "seconds", "time");
+    for (j = 0; profile->per_phase && j < PROFILE_COUNTERS; j++)
+        fprintf(out, "| %13s ", profile_counters[j]);
+    fprintf(out, "|\n");
+    fprintf(out, "+%.*s+%.*s+%.*s+%.*s", 13, padding, 12, padding, 10, padding, 8, padding);
+    for (j = 0; profile->per_phase && j < PROFILE_COUNTERS; j++)
+        fprintf(out, "+%.*s", 15, padding);
+    fprintf(out, "+\n");
+
+    for (i = 0; i < PROFILE_PHASES; i++) {
+        fprintf(out, "| %-11s | %10lu | %8.3f | %5.1f%% ", profile_phases[i], (unsigned long) profile->calls[i],
+                ticks ? seconds * profile->ticks[i] / ticks : 0, ticks ? 100.0 * profile->ticks[i] / ticks : 0);
+        for (j = 0; profile->per_phase && j < PROFILE_COUNTERS; j++)
+            fprintf(out, "| %13lu ", (unsigned long) profile->counts[i][j]);
+        fprintf(out, "|\n");
+    }
+
+    fprintf(out, "+%.*s+%.*s+%.*s+%.*s", 13, padding, 12, padding, 10, padding, 8, padding);
+    for (j = 0; profile->per_phase && j < PROFILE_COUNTERS; j++)
+        fprintf(out, "+%.*s", 15, padding);
+    fprintf(out, "+\n");
+
+    if (!profile->per_phase) {
+        for (j = 0; j < PROFILE_COUNTERS; j++) {
+            if (profile->fd[j] < 0)
+                fprintf(out, "\t %s: unavailable (%s) \n", profile_counters[j], strerror(profile->error));
+            else
+                fprintf(out, "\t %s for the whole run: %lu \n", profile_counters[j],
+                        (unsigned long) (iplc_sim_profile_read(profile->fd[j]) - profile->start_count[j]));
+        }
+    }
+
+    for (j = 0; j < PROFILE_COUNTERS; j++) {
+        if (profile->page[j] != NULL)
+            munmap(profile->page[j], sysconf(_SC_PAGESIZE));
+        if (profile->fd[j] >= 0)
+            close(profile->fd[j]);
+    }
+    free(profile);
+}
+
+
+
+//*****Cache Function Implementations*****//
+// Find the metadata of one set inside the cache allocation
+static inline cache_set_t iplc_sim_cache_set_at(cache_t *cache, int index) {
+    cache_set_t set;
+    uint8_t *base = cache->sets + cache->set_bytes * index;
+
+    set.valid = (uint64_t*) base;
+    set.tag = (uint32_t*) (base + sizeof(uint64_t));
+    set.line = cache->lines ? set.tag + cache->ways : NULL;
+    set.repl = base + cache->repl_offset;
+    return set;
+}
+
+/*  Compare a tag against every way of a set. Returns a mask with bit i set
+    when way i holds the tag, valid or not. ways is either below or a
+    multiple of CACHE_TAG_LANES. Built with AVX2 or SSE2 when the compiler
+    targets them (e.g. make CFLAGS="-O2 -Wall -mavx2"), define
+    IPLC_SIM_NO_SIMD to force the scalar loop. */
+static inline uint64_t iplc_sim_tag_match(const uint32_t *tags, int ways, uint32_t tag) {
+    uint64_t match = 0;
+    int i;
+
+    // Small sets aren't padded out to a whole vector
+    if (ways < CACHE_TAG_LANES) {
+        for (i = 0; i < ways; i++)
+            match |= (uint64_t) (tags[i] == tag) << i;
+        return match;
+    }
+
+#if !defined(IPLC_SIM_NO_SIMD) && defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32((int) tag);
+    for (i = 0; i < ways; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (tags + i)), key);
+        match |= (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(eq)) << i;
+    }
+#elif !defined(IPLC_SIM_NO_SIMD) && defined(__SSE2__)
+    __m128i key = _mm_set1_epi32((int) tag);
+    for (i = 0; i < ways; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (tags + i)), key);
+        match |= (uint64_t) _mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+    }
+#else
+    for (i = 0; i < ways; i++) {
+        match |= (uint64_t) (tags[i] == tag) << i;
+    }
+#endif
+
+    return match;
+}
+
+/*  iplc_sim_cache_lookup() determined this is not in our cache. Put it there,
+    in a free way if there is one and otherwise where the policy says. When
+    victim isn't NULL it is set to the line that was pushed out, which is
+    only known if the cache tracks line addresses. */
+void iplc_sim_replace_on_miss(cache_t *cache, int index, int tag, unsigned int address, cache_victim_t *victim) {
+    int target_line = 0;
+    cache_set_t set = iplc_sim_cache_set_at(cache, index);
+    uint64_t valid = *set.valid;
+
+    iplc_sim_profile_enter(cache->profile, PROFILE_REPLACEMENT);
+    
+    // Find the target block to insert our new block
+    if (valid != iplc_sim_all_ways(cache->assoc)) {
+        // If there is an empty space, just insert it
+        target_line = __builtin_ctzll(~valid);
+    } else {
+        target_line = cache->replacement->victim(cache, set.repl);
+        if (cache->set_stats != NULL)
+            cache->set_stats[index].evict++;
+    }
+
+    if (victim != NULL) {
+        victim->valid = set.line != NULL && ((valid >> target_line) & 1);
+        if (victim->valid)
+            victim->address = set.line[target_line] << cache->blockoffsetbits;
+    }
+    
+    // Replace the tage of the target block and change the valid bit
+    set.tag[target_line] = tag;
+    if (set.line != NULL)
+        set.line[target_line] = address >> cache->blockoffsetbits;
+    *set.valid |= 1ull << target_line;
+    
+    cache->replacement->fill(cache, set.repl, target_line, valid);
+
+    iplc_sim_profile_leave(cache->profile);
+}
+
+/*  iplc_sim_cache_lookup() determined the entry is in our cache. Update its
+    information in the cache. */
+void iplc_sim_update_on_hit(cache_t *cache, int index, int assoc_entry) {
+    cache_set_t set = iplc_sim_cache_set_at(cache, index);
+
+    iplc_sim_profile_enter(cache->profile, PROFILE_REPLACEMENT);
+    cache->replacement->touch(cache, set.repl, assoc_entry, *set.valid);
+    iplc_sim_profile_leave(cache->profile);
+}
+
+/*  Check if the address is in the cache. If our configuration supports
+    associativity we may need to check through multiple entries for our
+    desired index.  In that case we will also need to call the replacement
+    functions. Returns 1 for a hit, 0 for a miss, the line is in the cache
+    either way afterwards. victim (may be NULL) is set as for
+    iplc_sim_replace_on_miss(), it is never valid on a hit. */
+int iplc_sim_cache_lookup(cache_t *cache, unsigned int address, cache_victim_t *victim) {
+    int index = iplc_sim_cache_set(cache->index, cache->blockoffsetbits, address);
+    int tag = iplc_sim_cache_tag(cache->index, cache->blockoffsetbits, address);
+    cache_set_t set = iplc_sim_cache_set_at(cache, index);
+    
+    // Search every way of the set for the tag at once
+    uint64_t match = iplc_sim_tag_match(set.tag, cache->ways, (uint32_t) tag) & *set.valid;
+
+    if (cache->set_stats != NULL) {
+        cache->set_stats[index].access++;
+        cache->set_stats[index].miss += !match;
+    }
+
+    // Handle the case of a cahe hit
+    if (match) {
+        iplc_sim_update_on_hit(cache, index, __builtin_ctzll(match));
+        if (victim != NULL)
+            victim->valid = 0;
+        return 1;
+    }
+    
+    // Handle the case of a cache miss
+    iplc_sim_replace_on_miss(cache, index, tag, address, victim);
+    return 0;
+}
+
+// Drop the line holding address from the cache. Returns 1 if it was there.
+int iplc_sim_cache_invalidate(cache_t *cache, unsigned int address) {
+    int index = iplc_sim_cache_set(cache->index, cache->blockoffsetbits, address);
+    int tag = iplc_sim_cache_tag(cache->index, cache->blockoffsetbits, address);
+    cache_set_t set = iplc_sim_cache_set_at(cache, index);
+    uint64_t match = iplc_sim_tag_match(set.tag, cache->ways, (uint32_t) tag) & *set.valid;
+    int way;
+
+    if (!match)
+        return 0;
+
+    way = __builtin_ctzll(match);
+    cache->replacement->evict(cache, set.repl, way, *set.valid);
+    *set.valid &= ~(1ull << way);
+    return 1;
+}
+
+// Drop every line of the cache that lies in the (1 << blockoffsetbits) byte block at address
+static void iplc_sim_cache_invalidate_block(cache_t *cache, unsigned int address, int blockoffsetbits) {
+    uint64_t end = (uint64_t) address + (1ull << blockoffsetbits);
+    uint64_t step = 1ull << cache->blockoffsetbits;
+    uint64_t a;
+
+    for (a = address; a < end; a += step)
+        iplc_sim_cache_invalidate(cache, (unsigned int) a);
+}
+
+/*  Level i (0 is L2) of an inclusive hierarchy evicted a line, so it has to
+    leave every cache above that level as well. */
+static void iplc_sim_back_invalidate(sim_t *sim, int i, const cache_victim_t *victim) {
+    int blockoffsetbits = sim->level[i].blockoffsetbits;
+
+    iplc_sim_cache_invalidate_block(&sim->cache, victim->address, blockoffsetbits);
+    if (sim->config.data_cache == DCACHE_SPLIT)
+        iplc_sim_cache_invalidate_block(&sim->dcache, victim->address, blockoffsetbits);
+    while (i-- > 0)
+        iplc_sim_cache_invalidate_block(&sim->level[i], victim->address, blockoffsetbits);
+}
+
+/*  An L1 cache missed on address and has already taken the line in,
+    pushing out l1_victim. Walk down the levels below until one has the line,
+    keeping to the inclusion policy, and return the cycles it took. With no
+    levels below L1 that is just the memory latency. */
+static int iplc_sim_hierarchy_miss(sim_t *sim, unsigned int address, const cache_victim_t *l1_victim) {
+    int inclusion = sim->config.inclusion;
+    int cycles = 0;
+    int hit = 0;
+    int i;
+    cache_victim_t victim;
+
+    for (i = 0; i < sim->config.levels && !hit; i++) {
+        cache_t *level = &sim->level[i];
+
+        cycles += level->latency;
+        level->access++;
+
+        if (inclusion == INCLUSION_EXCLUSIVE) {
+            // The line moves up into L1, it can't stay down here as well
+            hit = iplc_sim_cache_invalidate(level, address);
+        }
+        else {
+            hit = iplc_sim_cache_lookup(level, address, &victim);
+            if (victim.valid && inclusion == INCLUSION_INCLUSIVE)
+                iplc_sim_back_invalidate(sim, i, &victim);
+        }
+
+        if (hit)
+            level->hit++;
+        else
+            level->miss++;
+    }
+
+    if (!hit)
+        cycles += sim->memory_latency;
+
+    // Exclusive levels catch what the level above dropped, passing their own victim further down
+    if (inclusion == INCLUSION_EXCLUSIVE) {
+        victim = *l1_victim;
+        for (i = 0; i < sim->config.levels && victim.valid; i++)
+            iplc_sim_cache_lookup(&sim->level[i], victim.address, &victim);
+    }
+
+    return cycles;
+}
+
+/*  Fetch an instruction through the cache. Update our counter statistics
+    for cache_access, cache_hit, etc. */
+int iplc_sim_trap_address(sim_t *sim, unsigned int address) {
+    cache_victim_t victim;
+    int hit;
+
+    iplc_sim_profile_enter(sim->config.profile, PROFILE_LOOKUP);
+    hit = iplc_sim_cache_lookup(&sim->cache, address, &victim);
+
+    if (hit)
+        sim->cache_hit += 1;
+    else {
+        sim->cache_miss += 1;
+        sim->miss_cycles = iplc_sim_hierarchy_miss(sim, address, &victim);
+        sim->memory_cycles += sim->miss_cycles;
+        sim->fetch_memory_cycles += sim->miss_cycles;
+        if (sim->pc_stats.entries != NULL)
+            iplc_sim_attribute_miss(sim, address, sim->miss_cycles);
+    }
+    
+    // Increment access counter
+    sim->cache_access += 1;
+
+    iplc_sim_profile_leave(sim->config.profile);
+    
+    // Expects you to return 1 for hit, 0 for miss
+    return hit;
+}
+
+/*  A lw/sw reached MEM, look its data up in the data cache (or the unified
+    cache) and count it in data_access, data_hit, etc. pc is the lw/sw's own
+    address, which a miss is attributed to. */
+int iplc_sim_trap_data_address(sim_t *sim, unsigned int pc, unsigned int address) {
+    cache_t *cache = (sim->config.data_cache == DCACHE_SPLIT) ? &sim->dcache : &sim->cache;
+    cache_victim_t victim;
+    int hit;
+
+    iplc_sim_profile_enter(sim->config.profile, PROFILE_LOOKUP);
+    hit = iplc_sim_cache_lookup(cache, address, &victim);
+
+    if (hit)
+        sim->data_hit += 1;
+    else {
+        sim->data_miss += 1;
+        sim->miss_cycles = iplc_sim_hierarchy_miss(sim, address, &victim);
+        sim->memory_cycles += sim->miss_cycles;
+        if (sim->pc_stats.entries != NULL)
+            iplc_sim_attribute_miss(sim, pc, sim->miss_cycles);
+    }
+
+    sim->data_access += 1;
+
+    iplc_sim_profile_leave(sim->config.profile);
+
+    return hit;
+}
+
+// CPI of the run, the mean of the samples' when sampling
+double iplc_sim_cpi(const sim_t *sim) {
+    if (sim->sample_period)
+        return sim->samples ? sim->sample_cpi / (double) sim->samples : 0;
+    return sim->instruction_count ? (double) sim->pipeline_cycles / (double) sim->instruction_count : 0;
+}
+
+/*  The two sided 95% quantile of Student's t with df degrees of freedom,
+    from a table up to 30 and the Cornish-Fisher expansion past it, which
+    is within 0.001 there and tends to the normal 1.96. */
+static double iplc_sim_student_t95(long df) {
+    static const double t95[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    const double z = 1.959964;
+    double n = (double) df;
+
+    if (df < 1)
+        return 0;
+    if (df <= 30)
+        return t95[df - 1];
+    return z + (z * z * z + z) / (4 * n) + (5 * pow(z, 5) + 16 * z * z * z + 3 * z) / (96 * n * n);
+}
+
+// Just output our summary statistics.
+void iplc_sim_finalize(sim_t *sim) {
+    const predictor_t *pred = &sim->predictor;
+    int i;
+
+    // A window the trace ended right after still counts
+    if (sim->sample_start >= 0 && sim->sample_records - sim->sample_start == sim->sample_window)
+        iplc_sim_sample_close(sim);
+
+    // Finish processing all instructions in the Pipeline, or the out-of-order core's window
+    if (sim->ooo != NULL)
+        iplc_sim_ooo_drain(sim);
+    for (i = 0; i < sim->pipeline_depth * sim->width; i++) {
+        if (iplc_sim_stage(sim, i / sim->width)[i % sim->width].itype != NOP) {
+            iplc_sim_push_pipeline_stage(sim);
+            i = -1; // look at every stage again
+        }
+    }
+
+    // The report follows everything traced
+    iplc_sim_events_close(sim);
+    iplc_sim_interval_close(sim);
+    
+    fprintf(sim->out, " Cache Performance \n");
+    fprintf(sim->out, "\t Number of Cache Accesses is %ld \n", sim->cache_access);
+    fprintf(sim->out, "\t Number of Cache Misses is %ld \n", sim->cache_miss);
+    fprintf(sim->out, "\t Number of Cache Hits is %ld \n", sim->cache_hit);
+    fprintf(sim->out, "\t Cache Miss Rate is %f \n\n", (double)sim->cache_miss / (double) sim->cache_access);
+    if (sim->config.data_cache != DCACHE_NONE) {
+        fprintf(sim->out, " Data Cache Performance \n");
+        fprintf(sim->out, "\t Number of Data Accesses is %ld \n", sim->data_access);
+        fprintf(sim->out, "\t Number of Data Misses is %ld \n", sim->data_miss);
+        fprintf(sim->out, "\t Number of Data Hits is %ld \n", sim->data_hit);
+        fprintf(sim->out, "\t Data Miss Rate is %f \n\n", (double)sim->data_miss / (double) sim->data_access);
+    }
+    for (i = 0; i < sim->config.levels; i++) {
+        cache_t *level = &sim->level[i];
+
+        fprintf(sim->out, " L%d Cache Performance \n", i + 2);
+        fprintf(sim->out, "\t Number of Cache Accesses is %ld \n", level->access);
+        fprintf(sim->out, "\t Number of Cache Misses is %ld \n", level->miss);
+        fprintf(sim->out, "\t Number of Cache Hits is %ld \n", level->hit);
+        fprintf(sim->out, "\t Cache Hit Rate is %f \n\n", level->access ? (double) level->hit / (double) level->access : 0);
+    }
+    if (sim->config.levels > 0) {
+        // Every L1 access takes the one pipeline cycle, misses add the time spent below L1
+        fprintf(sim->out, " Memory Hierarchy Performance \n");
+        fprintf(sim->out, "\t Average Memory Access Time is %f cycles \n\n",
+                1.0 + (double) sim->memory_cycles / (double) (sim->cache_access + sim->data_access));
+    }
+    fprintf(sim->out, "Pipeline Performance \n");
+    fprintf(sim->out, "\t Total Cycles is %u \n", sim->pipeline_cycles);
+    fprintf(sim->out, "\t Total Instructions is %u \n", sim->instruction_count);
+    fprintf(sim->out, "\t Total Branch Instructions is %u \n", sim->branch_count);
+    fprintf(sim->out, "\t Total Correct Branch Predictions is %u \n", sim->correct_branch_predictions);
+    if (sim->width > 1 || sim->ooo != NULL)
+        fprintf(sim->out, "\t IPC is %f \n", (double) sim->instruction_count / (double) sim->pipeline_cycles);
+    fprintf(sim->out, "\t CPI is %f \n\n", (double)sim->pipeline_cycles / (double) sim->instruction_count);
+
+    if (sim->sample_period) {
+        /*  the windows' CPI are a sample of the whole trace's, the interval is
+            the 95% one from Student's t. It only covers how the windows vary,
+            not a bias of all of them alike, from too short a warmup say. */
+        double mean = iplc_sim_cpi(sim);
+        double variance = (sim->samples > 1) ?
+            (sim->sample_cpi_squares - sim->samples * mean * mean) / (double) (sim->samples - 1) : 0;
+        double interval = (sim->samples > 1 && variance > 0) ?
+            iplc_sim_student_t95(sim->samples - 1) * sqrt(variance / (double) sim->samples) : 0;
+
+        fprintf(sim->out, " Sampling Performance \n");
+        fprintf(sim->out, "\t Number of Samples is %ld \n", sim->samples);
+        fprintf(sim->out, "\t Measured Instructions is %ld \n", sim->samples * sim->sample_window);
+        fprintf(sim->out, "\t Warmed Instructions is %ld \n", sim->warmed);
+        fprintf(sim->out, "\t Estimated CPI is %f \n", mean);
+        fprintf(sim->out, "\t CPI Standard Deviation is %f \n", variance > 0 ? sqrt(variance) : 0);
+        if (sim->samples > 1)
+            fprintf(sim->out, "\t CPI 95%% Confidence Interval is +/- %f (%f%%) \n", interval,
+                    mean > 0 ? 100.0 * interval / mean : 0);
+        else
+            fprintf(sim->out, "\t CPI 95%% Confidence Interval is unknown with fewer than 2 samples \n");
+        if (sim->samples < SAMPLE_MIN_SAMPLES)
+            fprintf(sim->out, "\t Warning: %ld samples are too few to trust the estimate, it takes %d; "
+                    "sample more often or run a longer trace \n", sim->samples, SAMPLE_MIN_SAMPLES);
+        fprintf(sim->out, "\t Estimated Total Cycles is %.0f \n\n", mean * (double) sim->sample_records);
+    }
+
+    if (sim->ooo != NULL) {
+        const ooo_t *ooo = sim->ooo;
+
+        fprintf(sim->out, " Out-of-Order Core Performance \n");
+        fprintf(sim->out, "\t ROB Full Stall Cycles is %ld \n", ooo->rob_stalls);
+        fprintf(sim->out, "\t Issue Queue Full Stall Cycles is %ld \n", ooo->iq_stalls);
+        fprintf(sim->out, "\t LSQ Full Stall Cycles is %ld \n", ooo->lsq_stalls);
+        fprintf(sim->out, "\t Load Misses is %ld \n", ooo->load_misses);
+        fprintf(sim->out, "\t Load Miss Latency is %ld cycles \n", ooo->miss_latency);
+        fprintf(sim->out, "\t Exposed Load Miss Latency is %ld cycles \n", ooo->exposed_latency);
+        fprintf(sim->out, "\t Memory Latency Hidden is %f \n\n",
+                ooo->miss_latency ? 1.0 - (double) ooo->exposed_latency / (double) ooo->miss_latency : 0);
+    }
+    else if (sim->config.forwarding != FWD_LEGACY) {
+        fprintf(sim->out, " Hazard Performance \n");
+        fprintf(sim->out, "\t Data Hazard Stall Cycles is %ld \n", sim->hazard_stalls);
+        fprintf(sim->out, "\t Load-Use Stall Cycles is %ld \n\n", sim->load_use_stalls);
+    }
+
+    if (sim->config.predictor != PRED_STATIC || pred->btb_bits) {
+        fprintf(sim->out, " Branch Prediction Performance \n");
+        fprintf(sim->out, "\t Prediction Accuracy is %f \n",
+                pred->predictions ? (double) pred->correct / (double) pred->predictions : 0);
+        fprintf(sim->out, "\t Total Mispredictions is %ld \n", pred->predictions - pred->correct);
+        fprintf(sim->out, "\t Mispredict Penalty Cycles is %ld \n", pred->mispredict_cycles);
+        if (sim->config.predictor == PRED_TOURNAMENT) {
+            fprintf(sim->out, "\t Local Predictor Accuracy is %f \n",
+                    pred->predictions ? (double) pred->local_correct / (double) pred->predictions : 0);
+            fprintf(sim->out, "\t Global Predictor Accuracy is %f \n",
+                    pred->predictions ? (double) pred->global_correct / (double) pred->predictions : 0);
+        }
+        if (pred->btb_bits)
+            fprintf(sim->out, "\t BTB Hit Rate is %f \n",
+                    pred->btb_lookups ? (double) pred->btb_hits / (double) pred->btb_lookups : 0);
+        fprintf(sim->out, "\n");
+    }
+
+    if (sim->pc_stats.entries != NULL)
+        iplc_sim_attribution_report(sim);
+}
+
+
+
+//*****Pipeline Functions*****//
+// Name of a stage when dumping the pipeline, stages without a role are just numbered
+static const char* iplc_sim_stage_name(sim_t *sim, int stage, char *buffer, size_t size) {
+    if (stage == FETCH)
+        return "FETCH";
+    if (stage == sim->pipeline_depth - 1)
+        return "WB";
+    if (stage == sim->mem_stage)
+        return "MEM";
+    if (stage == sim->mem_stage - 1)
+        return "ALU";
+    if (stage == sim->branch_stage)
+        return "DECODE";
+
+    snprintf(buffer, size, "S%d", stage);
+    return buffer;
+}
+
+// Dump the current contents of our pipeline
+void iplc_sim_dump_pipeline(sim_t *sim) {
+    int i;
+
+    // the out-of-order core has no pipeline to show
+    if (!(sim->events & EVENT_BIT(EVENT_PIPELINE)) || sim->ooo != NULL || sim->warming)
+        return;
+    
+    for (i = 0; i < sim->pipeline_depth * sim->width; i++) {
+        pipeline_t *lane = &iplc_sim_stage(sim, i / sim->width)[i % sim->width];
+
+        // arg is the stage, and the lane from bit 8 up
+        iplc_sim_event(sim, EVENT_PIPELINE, lane->instruction_address, lane->itype,
+                       (i / sim->width) | (i % sim->width) << 8);
+    }
+}
+
+// The scoreboard bit of a register, $0 and registers the trace didn't give (-1) have none
+static inline uint32_t iplc_sim_reg_bit(int reg) {
+    return (reg > 0 && reg < 32) ? 1u << reg : 0;
+}
+
+/*  Ticks after an instruction goes into ALU until one behind it can be in
+    ALU with its result: the next tick over EX->EX, once it is through MEM
+    over MEM->EX and without forwarding once WRITEBACK has written it to the
+    register file, which is read the stage before ALU. */
+static inline uint32_t iplc_sim_result_latency(const sim_t *sim, const pipeline_t *producer) {
+    int alu = sim->mem_stage - 1;
+
+    switch (sim->config.forwarding) {
+        case FWD_FULL:
+            return (producer->itype == LW) ? sim->mem_stage - alu + 1 : 1;
+        case FWD_MEM:
+            return sim->mem_stage - alu + 1;
+        default:
+            return sim->pipeline_depth - alu;
+    }
+}
+
+// A register of mask still not ready at tick, -1 if there is none
+static inline int iplc_sim_scoreboard_wait(sim_t *sim, uint32_t mask, uint32_t tick) {
+    int reg;
+
+    for (mask &= sim->pending; mask; mask &= mask - 1) {
+        reg = __builtin_ctz(mask);
+        if ((int32_t) (sim->ready[reg] - tick) > 0)
+            return reg;
+        sim->pending &= ~(1u << reg); // ready from now on, until written again
+    }
+    return -1;
+}
+
+/*  Check the bundle going into ALU, and any sw going into MEM with the
+    data it stores, against the scoreboard for the coming tick. Returns the
+    stage everything in front of has to stay put while a bubble goes into
+    it, or 0 if the whole pipeline moves and the bundle now in ALU has its
+    results scheduled. Branches read their registers going into ALU like
+    everything else, where they resolve is up to -branchstage. A bundle
+    never reads what it writes itself, see iplc_sim_fetch(). */
+static int iplc_sim_scoreboard(sim_t *sim, pipeline_t *issue, pipeline_t *alu, uint32_t tick) {
+    pipeline_t *waiting = alu;
+    uint32_t reads = 0, reads_late = 0, bit;
+    int hold = sim->mem_stage;
+    int reg, lane;
+
+    for (lane = 0; lane < sim->width; lane++) {
+        reads |= issue[lane].reads;
+        reads_late |= alu[lane].reads_late;
+    }
+
+    reg = iplc_sim_scoreboard_wait(sim, reads_late, tick);
+    if (reg < 0) {
+        waiting = issue;
+        hold = sim->mem_stage - 1;
+        reg = iplc_sim_scoreboard_wait(sim, reads, tick);
+    }
+
+    if (reg >= 0) {
+        sim->hazard_stalls++;
+        if (sim->pending_loads & (1u << reg))
+            sim->load_use_stalls++;
+        iplc_sim_event(sim, EVENT_STALL, waiting->instruction_address, waiting->itype, 1);
+        return hold;
+    }
+
+    for (lane = 0; lane < sim->width; lane++) {
+        if (issue[lane].writes) {
+            bit = issue[lane].writes;
+            reg = __builtin_ctz(bit);
+            sim->ready[reg] = tick + iplc_sim_result_latency(sim, &issue[lane]);
+            sim->pending |= bit;
+            if (issue[lane].itype == LW)
+                sim->pending_loads |= bit;
+            else
+                sim->pending_loads &= ~bit;
+        }
+    }
+    return 0;
+}
+
+/*  Check if various stages of our pipeline require stalls, forwarding, etc.
+    Then push the contents of our various pipeline stages through the pipeline.
+    Every stage is a bundle of sim->width lanes, see sim_t.
+    Returns the number of stall cycles, each of which pushes the pipeline
+    once more. */
+static int iplc_sim_pipeline_cycle(sim_t *sim)
+{
+    pipeline_t *wb = iplc_sim_stage(sim, sim->pipeline_depth - 1);
+    pipeline_t *mem = iplc_sim_stage(sim, sim->mem_stage);
+    pipeline_t *alu = iplc_sim_stage(sim, sim->mem_stage - 1);
+    pipeline_t *decode = iplc_sim_stage(sim, sim->branch_stage);
+    pipeline_t *behind = iplc_sim_stage(sim, sim->branch_stage - 1); // fetched right after decode
+    int data_hit=1;
+    int data_cycles = 0;
+    int i, j;
+
+    int stall = 0;
+    int hazard = 0;
+    int hold = 0;
+    
+    /* 1. Count WRITEBACK stage is "retired" -- This I'm giving you */
+    for (i = 0; i < sim->width; i++) {
+        if (wb[i].instruction_address) {
+            sim->instruction_count++;
+            iplc_sim_event(sim, EVENT_RETIRE, wb[i].instruction_address, wb[i].itype, 0);
+        }
+    }
+    
+    /* 2. Check for BRANCH and correct/incorrect Branch Prediction, unless the
+     *    scoreboard held the branch where it was last cycle */
+    for (i = 0; i < sim->width && sim->held <= sim->branch_stage; i++) {
+        if (decode[i].itype == BRANCH) {
+            // what came after the branch is the next lane, or the first one of the bundle behind
+            pipeline_t *next = (i + 1 < sim->width && decode[i + 1].instruction_address) ? &decode[i + 1] : behind;
+            int branch_taken = 0;
+            sim->branch_count++;
+            if(next->instruction_address != (decode[i].instruction_address + 4) ){
+                branch_taken++;
+            }
+            // the predictor stands in for the static predict taken / not taken choice
+            if (iplc_sim_predict_branch(sim, decode[i].instruction_address, branch_taken, next->instruction_address)) {
+                sim->correct_branch_predictions++;
+            }
+            else {
+                stall = sim->branch_stage; // one cycle for each stage fetched down the wrong path
+                sim->predictor.mispredict_cycles += stall;
+                iplc_sim_event(sim, EVENT_MISPREDICT, decode[i].instruction_address, BRANCH, stall);
+            }
+        }
+    }
+    
+    /* Look lw/sw data up as it reaches MEM when data accesses are modelled,
+     * the misses of one bundle are serviced side by side */
+    for (i = 0; i < sim->width && sim->config.data_cache != DCACHE_NONE; i++) {
+        if (mem[i].itype == LW || mem[i].itype == SW) {
+            unsigned int data_address = (mem[i].itype == LW) ? mem[i].stage.lw.data_address
+                                                               : mem[i].stage.sw.data_address;
+
+            if (iplc_sim_trap_data_address(sim, mem[i].instruction_address, data_address)) {
+                iplc_sim_event(sim, EVENT_DATA_HIT, data_address, mem[i].itype, 0);
+            }
+            else {
+                data_hit = 0;
+                if (sim->miss_cycles > data_cycles)
+                    data_cycles = sim->miss_cycles;
+                iplc_sim_event(sim, EVENT_DATA_MISS, data_address, mem[i].itype, sim->miss_cycles);
+            }
+        }
+    }
+
+    /* 3. Check for LW delays due to use in ALU stage and if data hit/miss
+     *    add delay cycles if needed.
+     */
+    if (sim->config.forwarding != FWD_LEGACY) {
+        hold = iplc_sim_scoreboard(sim, iplc_sim_stage(sim, sim->mem_stage - 2), alu, ++sim->hazard_clock);
+        hazard = (hold != 0);
+    }
+    else {
+        for (i = 0; i < sim->width * sim->width && !hazard; i++) {
+            pipeline_t *load = &mem[i / sim->width], *use = &alu[i % sim->width];
+
+            if (load->itype == LW && use->itype == RTYPE) {
+                if(use->stage.rtype.reg1 == load->stage.lw.dest_reg
+                    || use->stage.rtype.reg2_or_constant == load->stage.lw.dest_reg){
+                    hazard = 1;
+                    sim->hazard_stalls++;
+                    iplc_sim_event(sim, EVENT_STALL, use->instruction_address, use->itype, hazard);
+                }
+            }
+        }
+    }
+    
+    /* 4. The SW check that was here compared the SW's base register with the
+     *    destination of the RTYPE behind it in ALU. That is a write after
+     *    read, which an in-order pipeline never stalls on, and it could only
+     *    fire once base registers stopped being passed as -1. */
+
+    /* 5. Increment pipe_cycles 1 cycle for normal processing, the whole
+     *    pipeline waits out a data miss in MEM */
+    sim->pipeline_cycles++;
+    if (!data_hit)
+        sim->pipeline_cycles += data_cycles - 1;
+    /* 6. push every stage one down by moving the head back, WRITEBACK's slot
+     *    comes round as the new FETCH */
+    sim->pipeline_head = (sim->pipeline_head == 0) ? sim->pipeline_depth - 1 : sim->pipeline_head - 1;
+    
+    if (hold) {
+        // the stages in front of the hold stay where they were and a bubble goes into it
+        for (i = FETCH; i < hold; i++) {
+            pipeline_t *to = iplc_sim_stage(sim, i), *from = iplc_sim_stage(sim, i + 1);
+
+            for (j = 0; j < sim->width; j++)
+                to[j] = from[j];
+        }
+        bzero(iplc_sim_stage(sim, hold), sim->width * sizeof(pipeline_t));
+    }
+    else {
+        // 7. This is a give'me -- Reset the FETCH stage to NOP via bezero */
+        bzero(iplc_sim_stage(sim, FETCH), sim->width * sizeof(pipeline_t));
+    }
+    sim->held = hold;
+
+    return (hazard > stall) ? hazard : stall;
+}
+
+void iplc_sim_push_pipeline_stage(sim_t *sim)
+{
+    int pushes = 1;
+
+    iplc_sim_profile_enter(sim->config.profile, PROFILE_PIPELINE);
+
+    // Every stall cycle pushes everything through once more, and those can stall again
+    while (pushes-- > 0)
+        pushes += iplc_sim_pipeline_cycle(sim);
+
+    iplc_sim_profile_leave(sim->config.profile);
+}
+
+// True once every stage holds a bubble, pushing then only counts the cycle
+static inline int iplc_sim_pipeline_empty(const sim_t *sim) {
+    int i, j;
+
+    // only the first pipeline_depth slots of the ring and width lanes of each are ever used
+    for (i = 0; i < sim->pipeline_depth; i++) {
+        for (j = 0; j < sim->width; j++) {
+            if (sim->pipeline[i][j].itype != NOP || sim->pipeline[i][j].instruction_address != 0)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/*  Push the pipeline the given number of times, as a fetch miss does while
+    it waits. After at most pipeline_depth pushes only bubbles are left and
+    nothing can change any more, so the rest is added to pipeline_cycles in
+    one step. */
+void iplc_sim_advance_pipeline(sim_t *sim, int pushes)
+{
+    while (pushes > 0 && !iplc_sim_pipeline_empty(sim)) {
+        iplc_sim_push_pipeline_stage(sim);
+        pushes--;
+    }
+
+    if (pushes > 0)
+        sim->pipeline_cycles += pushes;
+}
+
+/*  Find the instruction being fetched a lane. It joins the bundle in FETCH
+    when there is a free lane and it follows the last instruction there in
+    sequence (a taken branch or jump ends a bundle), doesn't read or write a
+    register the bundle writes, and the bundle still has a memory port or
+    branch unit free if it needs one; a syscall always goes alone. Otherwise
+    the pipeline is pushed and it starts a new bundle. With a width of 1
+    this is just the push. */
+static pipeline_t* iplc_sim_fetch(sim_t *sim, int itype, uint32_t reads, uint32_t reads_late, uint32_t writes)
+{
+    pipeline_t *bundle = iplc_sim_stage(sim, FETCH);
+    pipeline_t *fetch;
+    uint32_t written = 0;
+    int lanes = 0, mem_ops = 0, branch_ops = 0;
+    int join = 0;
+
+    if (sim->width > 1) {
+        for (; lanes < sim->width && (bundle[lanes].instruction_address || bundle[lanes].itype != NOP); lanes++) {
+            written |= bundle[lanes].writes;
+            mem_ops += (bundle[lanes].itype == LW || bundle[lanes].itype == SW);
+            branch_ops += (bundle[lanes].itype == BRANCH || bundle[lanes].itype == JUMP);
+        }
+
+        join = lanes > 0 && lanes < sim->width &&
+               sim->instruction_address == bundle[lanes - 1].instruction_address + 4 &&
+               !((reads | reads_late | writes) & written) &&
+               !((itype == LW || itype == SW) && mem_ops == sim->mem_ports) &&
+               !((itype == BRANCH || itype == JUMP) && branch_ops == sim->branch_units) &&
+               itype != SYSCALL && bundle[lanes - 1].itype != SYSCALL;
+    }
+
+    if (!join) {
+        iplc_sim_push_pipeline_stage(sim);
+        lanes = 0;
+    }
+
+    fetch = &iplc_sim_stage(sim, FETCH)[lanes];
+    fetch->itype = itype;
+    fetch->instruction_address = sim->instruction_address;
+    fetch->reads = reads;
+    fetch->reads_late = reads_late;
+    fetch->writes = writes;
+    return fetch;
+}
+
+/*  Immediate and shift forms carry a constant rather than a second source
+    register in reg2_or_constant: addi, addiu, andi, ori, slti, sltiu, xori,
+    sll, srl and sra. */
+static inline int iplc_sim_rtype_immediate(const char *instruction) {
+    size_t length = strlen(instruction);
+
+    if (length > 0 && instruction[length - 1] == 'i')
+        return 1;
+    if (length > 1 && strcmp(instruction + length - 2, "iu") == 0)
+        return 1;
+    return strcmp(instruction, "sll") == 0 || strcmp(instruction, "srl") == 0 || strcmp(instruction, "sra") == 0;
+}
+
+/*
+ * This function is fully implemented.  You should use this as a reference
+ * for implementing the remaining instruction types.
+ */
+void iplc_sim_process_pipeline_rtype(sim_t *sim, const char *instruction, int dest_reg, int reg1, int reg2_or_constant)
+{
+    uint32_t reads = iplc_sim_reg_bit(reg1);
+
+    if (!iplc_sim_rtype_immediate(instruction))
+        reads |= iplc_sim_reg_bit(reg2_or_constant);
+
+    /* This is an example of what you need to do for the rest */
+    pipeline_t *fetch = iplc_sim_fetch(sim, RTYPE, reads, 0, iplc_sim_reg_bit(dest_reg));
+    
+    strcpy(fetch->stage.rtype.instruction, instruction);
+    fetch->stage.rtype.reg1 = reg1;
+    fetch->stage.rtype.reg2_or_constant = reg2_or_constant;
+    fetch->stage.rtype.dest_reg = dest_reg;
+
+    sim->inst_stats.rtype++;
+}
+
+void iplc_sim_process_pipeline_lw(sim_t *sim, int dest_reg, int base_reg, unsigned int data_address)
+{
+    /* You must implement this function */
+    pipeline_t *fetch = iplc_sim_fetch(sim, LW, iplc_sim_reg_bit(base_reg), 0, iplc_sim_reg_bit(dest_reg));
+
+    fetch->stage.lw.data_address = data_address;
+    fetch->stage.lw.dest_reg = dest_reg;
+    fetch->stage.lw.base_reg = base_reg;
+
+    sim->inst_stats.lw++;
+}
+
+void iplc_sim_process_pipeline_sw(sim_t *sim, int src_reg, int base_reg, unsigned int data_address)
+{
+    /* You must implement this function */
+    pipeline_t *fetch = iplc_sim_fetch(sim, SW, iplc_sim_reg_bit(base_reg), iplc_sim_reg_bit(src_reg), 0);
+
+    fetch->stage.sw.data_address = data_address;
+    fetch->stage.sw.src_reg = src_reg;
+    fetch->stage.sw.base_reg = base_reg;
+
+    sim->inst_stats.sw++;
+}
+
+void iplc_sim_process_pipeline_branch(sim_t *sim, int reg1, int reg2)
+{
+    /* You must implement this function */
+    pipeline_t *fetch = iplc_sim_fetch(sim, BRANCH, iplc_sim_reg_bit(reg1) | iplc_sim_reg_bit(reg2), 0, 0);
+
+    fetch->stage.branch.reg1 = reg1;
+    fetch->stage.branch.reg2 = reg2;
+
+    sim->inst_stats.branch++;
+}
+
+void iplc_sim_process_pipeline_jump(sim_t *sim, const char *instruction, int reg1)
+{
+    // jal and jalr link through $31, jr and jalr read the register they jump to
+    uint32_t writes = (strncmp(instruction, "jal", 3) == 0) ? iplc_sim_reg_bit(31) : 0;
+
+    /* You must implement this function */
+    pipeline_t *fetch = iplc_sim_fetch(sim, JUMP, iplc_sim_reg_bit(reg1), 0, writes);
+
+    strcpy(fetch->stage.jump.instruction, instruction);
+
+    sim->inst_stats.jump++;
+}
+
+void iplc_sim_process_pipeline_syscall(sim_t *sim)
+{
+    /* You must implement this function */
+    // the service number goes in $v0 ($2) and the result comes back there, $a0 ($4) is its argument
+    iplc_sim_fetch(sim, SYSCALL, iplc_sim_reg_bit(2) | iplc_sim_reg_bit(4), 0, iplc_sim_reg_bit(2));
+
+    sim->inst_stats.syscall++;
+}
+
+void iplc_sim_process_pipeline_nop(sim_t *sim)
+{
+    /* You must implement this function */
+    iplc_sim_fetch(sim, NOP, 0, 0, 0);
+
+    sim->inst_stats.nop++;
+}
+
+
+
+//*****Out-of-Order Core*****//
+static void* iplc_sim_ooo_table(size_t entries, size_t size) {
+    void *table = calloc(entries, size);
+
+    if (table == NULL) {
+        printf("Out of memory allocating the out-of-order core \n");
+        exit(-1);
+    }
+    return table;
+}
+
+// Set the out-of-order core up and report its configuration
+void iplc_sim_ooo_init(sim_t *sim) {
+    const sim_config_t *config = &sim->config;
+    ooo_t *ooo = (ooo_t*) iplc_sim_ooo_table(1, sizeof(ooo_t));
+    int i;
+
+    ooo->rob_size = config->rob_size ? config->rob_size : OOO_ROB_SIZE;
+    ooo->iq_size = config->iq_size ? config->iq_size : OOO_IQ_SIZE;
+    ooo->lsq_size = config->lsq_size ? config->lsq_size : OOO_LSQ_SIZE;
+    for (i = 0; i < FU_COUNT; i++)
+        ooo->latency[i] = config->fu_latency[i] ? config->fu_latency[i] : fu_default_latency[i];
+
+    fprintf(sim->out, "Out-of-Order Core Configuration \n");
+    fprintf(sim->out, "   Width: %d \n", sim->width);
+    fprintf(sim->out, "   ROB Entries: %d \n", ooo->rob_size);
+    fprintf(sim->out, "   Issue Queue Entries: %d \n", ooo->iq_size);
+    fprintf(sim->out, "   LSQ Entries: %d \n", ooo->lsq_size);
+    fprintf(sim->out, "   Latencies:");
+    for (i = 0; i < FU_COUNT; i++)
+        fprintf(sim->out, " %s %d", fu_names[i], ooo->latency[i]);
+    fprintf(sim->out, " \n");
+
+    if (ooo->rob_size < 1 || ooo->rob_size > OOO_MAX_ENTRIES || ooo->iq_size < 1 || ooo->iq_size > ooo->rob_size ||
+        ooo->lsq_size < 1 || ooo->lsq_size > ooo->rob_size) {
+        printf("The reorder buffer takes between 1 and %d entries, the issue and load/store queues at most as many \n",
+               OOO_MAX_ENTRIES);
+        exit(-1);
+    }
+
+    ooo->rob = (uint64_t*) iplc_sim_ooo_table(ooo->rob_size, sizeof(uint64_t));
+    ooo->lsq = (uint64_t*) iplc_sim_ooo_table(ooo->lsq_size, sizeof(uint64_t));
+    ooo->iq = (uint64_t*) iplc_sim_ooo_table(ooo->iq_size, sizeof(uint64_t));
+    ooo->slots = (ooo_slot_t*) iplc_sim_ooo_table(OOO_ISSUE_SLOTS, sizeof(ooo_slot_t));
+    sim->ooo = ooo;
+}
+
+// Empty the core, keeping its sizes and latencies
+void iplc_sim_ooo_reset(sim_t *sim) {
+    ooo_t *ooo = sim->ooo;
+    ooo_t fresh;
+
+    bzero(ooo->rob, ooo->rob_size * sizeof(uint64_t));
+    bzero(ooo->lsq, ooo->lsq_size * sizeof(uint64_t));
+    bzero(ooo->slots, OOO_ISSUE_SLOTS * sizeof(ooo_slot_t));
+
+    bzero(&fresh, sizeof(fresh));
+    fresh.rob_size = ooo->rob_size;
+    fresh.iq_size = ooo->iq_size;
+    fresh.lsq_size = ooo->lsq_size;
+    memcpy(fresh.latency, ooo->latency, sizeof(fresh.latency));
+    fresh.rob = ooo->rob;
+    fresh.lsq = ooo->lsq;
+    fresh.iq = ooo->iq;
+    fresh.slots = ooo->slots;
+    *ooo = fresh;
+}
+
+void iplc_sim_ooo_free(sim_t *sim) {
+    ooo_t *ooo = sim->ooo;
+
+    if (ooo == NULL)
+        return;
+    free(ooo->rob);
+    free(ooo->lsq);
+    free(ooo->iq);
+    free(ooo->slots);
+    free(ooo);
+    sim->ooo = NULL;
+}
+
+// Take the earliest issue cycle out of the issue queue
+static uint64_t iplc_sim_ooo_iq_pop(ooo_t *ooo) {
+    uint64_t *heap = ooo->iq;
+    uint64_t top = heap[0], last = heap[--ooo->iq_count];
+    int i = 0, child;
+
+    while ((child = 2 * i + 1) < ooo->iq_count) {
+        if (child + 1 < ooo->iq_count && heap[child + 1] < heap[child])
+            child++;
+        if (last <= heap[child])
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static void iplc_sim_ooo_iq_push(ooo_t *ooo, uint64_t cycle) {
+    int i = ooo->iq_count++, parent;
+
+    while (i > 0 && ooo->iq[parent = (i - 1) / 2] > cycle) {
+        ooo->iq[i] = ooo->iq[parent];
+        i = parent;
+    }
+    ooo->iq[i] = cycle;
+}
+
+/*  The first cycle from cycle on with an issue slot free, and a memory port
+    or branch unit if the instruction needs one, which it then takes. A slot
+    still tagged with an older cycle is free, nothing looks that far back:
+    every instruction issues after its dispatch and dispatch only moves on. */
+static uint64_t iplc_sim_ooo_issue(sim_t *sim, uint64_t cycle, int mem, int branch) {
+    ooo_slot_t *slot;
+
+    for (;; cycle++) {
+        slot = &sim->ooo->slots[cycle & (OOO_ISSUE_SLOTS - 1)];
+        if (slot->cycle != cycle) {
+            slot->cycle = cycle;
+            slot->issued = 0;
+            slot->mem = 0;
+            slot->branch = 0;
+        }
+        if (slot->issued < sim->width && !(mem && slot->mem == sim->mem_ports) &&
+            !(branch && slot->branch == sim->branch_units))
+            break;
+    }
+    slot->issued++;
+    slot->mem += mem;
+    slot->branch += branch;
+    return cycle;
+}
+
+// The cycle an instruction ready to commit at cycle does, width of them at most a cycle
+static inline uint64_t iplc_sim_ooo_commit(const sim_t *sim, uint64_t cycle) {
+    const ooo_t *ooo = sim->ooo;
+
+    if (cycle < ooo->commit_cycle)
+        cycle = ooo->commit_cycle;
+    if (cycle == ooo->commit_cycle && ooo->committed == sim->width)
+        cycle++;
+    return cycle;
+}
+
+/*  Resolve the branch before the instruction at address, now that it shows
+    where the branch went. After a mispredict fetch starts over on the right
+    path the cycle after the branch completes. */
+static void iplc_sim_ooo_resolve(sim_t *sim, unsigned int address) {
+    ooo_t *ooo = sim->ooo;
+    int taken = (address != ooo->branch_address + 4);
+    uint64_t redirect = ooo->branch_complete + 1;
+    int penalty = 0;
+
+    ooo->branch_pending = 0;
+    sim->branch_count++;
+    if (iplc_sim_predict_branch(sim, ooo->branch_address, taken, address)) {
+        sim->correct_branch_predictions++;
+        return;
+    }
+
+    if (redirect > ooo->fetch_cycle) {
+        penalty = (int) (redirect - ooo->fetch_cycle);
+        ooo->fetch_cycle = redirect;
+        ooo->fetched = 0;
+    }
+    sim->predictor.mispredict_cycles += penalty;
+    iplc_sim_event(sim, EVENT_MISPREDICT, ooo->branch_address, BRANCH, penalty);
+}
+
+/*  Time one instruction through the out-of-order core. Fetch takes up to
+    width instructions a cycle in sequence, a taken branch or jump or a
+    fetch miss ends the group. Dispatch, after the front end, waits for a
+    reorder buffer entry, a load/store queue entry for a lw/sw and room in
+    the issue queue, issue for its sources and a free slot, and commit for
+    the result and everything before it. A lw's latency is the address
+    generation and the data access; stores write at commit, so their misses
+    never hold anything up and neither does the data a sw stores, which is
+    read at issue with its base register. */
+void iplc_sim_ooo_record(sim_t *sim, const trace_record_t *rec, const char *instruction, int instruction_hit) {
+    ooo_t *ooo = sim->ooo;
+    unsigned int address = rec->instruction_address;
+    uint32_t reads = 0, writes = 0, mask;
+    int unit = FU_ALU, mem = 0, branch = 0, miss = 0;
+    uint64_t fetch, dispatch, issue, complete, commit, blocked;
+
+    if (ooo->branch_pending)
+        iplc_sim_ooo_resolve(sim, address);
+
+    if (ooo->fetched == sim->width || (ooo->fetched > 0 && address != ooo->last_address + 4)) {
+        ooo->fetch_cycle++;
+        ooo->fetched = 0;
+    }
+    if (!instruction_hit) {
+        // like the pipeline the miss takes miss_cycles in all, the fetch cycle included
+        ooo->fetch_cycle += (ooo->fetched > 0) + sim->miss_cycles - 1;
+        ooo->fetched = 0;
+    }
+    fetch = ooo->fetch_cycle;
+    ooo->fetched++;
+    ooo->last_address = address;
+    sim->pipeline_cycles = (unsigned int) fetch; // what the events are stamped with
+
+    switch (rec->itype) {
+        case RTYPE:
+            reads = iplc_sim_reg_bit(rec->reg1);
+            if (!iplc_sim_rtype_immediate(instruction))
+                reads |= iplc_sim_reg_bit(rec->reg2_or_constant);
+            writes = iplc_sim_reg_bit(rec->dest_reg);
+            if (strncmp(instruction, "mul", 3) == 0)
+                unit = FU_MUL;
+            else if (strncmp(instruction, "div", 3) == 0)
+                unit = FU_DIV;
+            sim->inst_stats.rtype++;
+            break;
+        case LW:
+            reads = iplc_sim_reg_bit(rec->reg1);
+            writes = iplc_sim_reg_bit(rec->dest_reg);
+            unit = FU_AGU;
+            mem = 1;
+            sim->inst_stats.lw++;
+            break;
+        case SW:
+            reads = iplc_sim_reg_bit(rec->reg1) | iplc_sim_reg_bit(rec->dest_reg);
+            unit = FU_AGU;
+            mem = 1;
+            sim->inst_stats.sw++;
+            break;
+        case BRANCH:
+            reads = iplc_sim_reg_bit(rec->reg1) | iplc_sim_reg_bit(rec->reg2_or_constant);
+            unit = FU_BRANCH;
+            branch = 1;
+            sim->inst_stats.branch++;
+            break;
+        case JUMP:
+            reads = iplc_sim_reg_bit(rec->reg1);
+            writes = (strncmp(instruction, "jal", 3) == 0) ? iplc_sim_reg_bit(31) : 0;
+            unit = FU_BRANCH;
+            branch = 1;
+            sim->inst_stats.jump++;
+            break;
+        case SYSCALL:
+            reads = iplc_sim_reg_bit(2) | iplc_sim_reg_bit(4);
+            writes = iplc_sim_reg_bit(2);
+            sim->inst_stats.syscall++;
+            break;
+        case NOP:
+            sim->inst_stats.nop++;
+            break;
+        default:
+            printf("Bad record type %d at address %x \n", rec->itype, rec->instruction_address);
+            exit(-1);
+    }
+
+    // Dispatch, in order
+    dispatch = fetch + OOO_FRONTEND;
+    if (dispatch < ooo->dispatch_cycle)
+        dispatch = ooo->dispatch_cycle;
+    if (ooo->instructions >= ooo->rob_size) {
+        // the entry is the one the instruction rob_size back frees as it commits
+        blocked = ooo->rob[ooo->instructions % ooo->rob_size] + 1;
+        if (blocked > dispatch) {
+            ooo->rob_stalls += blocked - dispatch;
+            dispatch = blocked;
+        }
+    }
+    if (mem && ooo->mem_ops >= ooo->lsq_size) {
+        blocked = ooo->lsq[ooo->mem_ops % ooo->lsq_size] + 1;
+        if (blocked > dispatch) {
+            ooo->lsq_stalls += blocked - dispatch;
+            dispatch = blocked;
+        }
+    }
+    // issue queue entries are free again once they issue
+    while (ooo->iq_count > 0 && ooo->iq[0] <= dispatch)
+        iplc_sim_ooo_iq_pop(ooo);
+    if (ooo->iq_count == ooo->iq_size) {
+        blocked = iplc_sim_ooo_iq_pop(ooo);
+        ooo->iq_stalls += blocked - dispatch;
+        dispatch = blocked;
+    }
+    if (dispatch == ooo->dispatch_cycle && ooo->dispatched == sim->width)
+        dispatch++;
+    if (dispatch != ooo->dispatch_cycle) {
+        ooo->dispatch_cycle = dispatch;
+        ooo->dispatched = 0;
+    }
+    ooo->dispatched++;
+
+    // the front end backs up behind a stalled dispatch
+    if (dispatch - OOO_FRONTEND > ooo->fetch_cycle) {
+        ooo->fetch_cycle = dispatch - OOO_FRONTEND;
+        ooo->fetched = 1;
+    }
+
+    // Issue once every source is ready
+    issue = dispatch + 1;
+    for (mask = reads; mask; mask &= mask - 1) {
+        if (ooo->ready[__builtin_ctz(mask)] > issue)
+            issue = ooo->ready[__builtin_ctz(mask)];
+    }
+    issue = iplc_sim_ooo_issue(sim, issue, mem, branch);
+    iplc_sim_ooo_iq_push(ooo, issue);
+    complete = issue + ooo->latency[unit];
+
+    if (mem && sim->config.data_cache != DCACHE_NONE) {
+        if (iplc_sim_trap_data_address(sim, address, rec->data_address)) {
+            iplc_sim_event(sim, EVENT_DATA_HIT, rec->data_address, rec->itype, 0);
+        }
+        else {
+            iplc_sim_event(sim, EVENT_DATA_MISS, rec->data_address, rec->itype, sim->miss_cycles);
+            if (rec->itype == LW) {
+                miss = sim->miss_cycles - 1;
+                ooo->load_misses++;
+                ooo->miss_latency += miss;
+            }
+        }
+    }
+    if (rec->itype == LW)
+        complete += 1 + miss;
+    if (writes)
+        ooo->ready[__builtin_ctz(writes)] = complete;
+
+    // Commit, in order
+    commit = iplc_sim_ooo_commit(sim, complete + 1);
+    if (miss)
+        ooo->exposed_latency += commit - iplc_sim_ooo_commit(sim, complete - miss + 1);
+    if (commit != ooo->commit_cycle) {
+        ooo->commit_cycle = commit;
+        ooo->committed = 0;
+    }
+    ooo->committed++;
+    ooo->rob[ooo->instructions % ooo->rob_size] = commit;
+    if (mem)
+        ooo->lsq[ooo->mem_ops++ % ooo->lsq_size] = commit;
+    ooo->instructions++;
+
+    if (rec->itype == BRANCH) {
+        ooo->branch_pending = 1;
+        ooo->branch_address = address;
+        ooo->branch_complete = complete;
+    }
+}
+
+/*  The trace is over: resolve a last branch against the bubble behind it,
+    as the pipeline does, and report the core's cycles as the pipeline's. */
+void iplc_sim_ooo_drain(sim_t *sim) {
+    ooo_t *ooo = sim->ooo;
+
+    if (ooo->branch_pending)
+        iplc_sim_ooo_resolve(sim, 0);
+    sim->instruction_count = (unsigned int) ooo->instructions;
+    sim->pipeline_cycles = ooo->instructions ? (unsigned int) (ooo->commit_cycle + 1) : 0;
+}
+
+
+
+//*****Sampled Simulation*****//
+/*  Drop whatever is in flight once a sample is over, so the next one starts
+    from an empty pipeline rather than one left thousands of records back. */
+static void iplc_sim_sample_flush(sim_t *sim) {
+    int i;
+
+    for (i = 0; i < MAX_STAGES; i++)
+        bzero(&(sim->pipeline[i]), sizeof(sim->pipeline[i]));
+    sim->pending = 0;
+    sim->pending_loads = 0;
+    sim->held = 0;
+    if (sim->ooo != NULL)
+        sim->ooo->branch_pending = 0;
+}
+
+// Close the open window, its CPI is one sample of the mean the report estimates
+void iplc_sim_sample_close(sim_t *sim) {
+    double cpi = (double) (sim->pipeline_cycles - sim->sample_cycles) / (double) sim->sample_window;
+
+    sim->samples++;
+    sim->sample_cpi += cpi;
+    sim->sample_cpi_squares += cpi * cpi;
+    sim->sample_start = -1;
+}
+
+/*  Work out where a record falls in its sample period, closing and opening
+    the measured window around it, and let a branch warmed before it learn
+    where it went. Returns 1 if the record is timed, 0 if it only warms. */
+static int iplc_sim_sample(sim_t *sim, const trace_record_t *rec) {
+    long pos = sim->sample_records % sim->sample_period;
+    int timed = (pos >= sim->sample_period - sim->sample_window - sim->sample_warmup);
+
+    if (sim->warm_branch) {
+        iplc_sim_train_branch(sim, sim->warm_branch, rec->instruction_address != sim->warm_branch + 4,
+                              rec->instruction_address);
+        sim->warm_branch = 0;
+    }
+
+    if (sim->sample_start >= 0 && sim->sample_records - sim->sample_start == sim->sample_window) {
+        iplc_sim_sample_close(sim);
+        if (!timed)
+            iplc_sim_sample_flush(sim);
+    }
+    if (pos == sim->sample_period - sim->sample_window) {
+        sim->sample_start = sim->sample_records;
+        sim->sample_cycles = sim->pipeline_cycles;
+    }
+
+    sim->sample_records++;
+    return timed;
+}
+
+/*  Warm the caches and the predictor with a record between samples. Its
+    fetch has already been through the cache, a lw/sw's data goes through
+    the data cache and a branch trains the predictor once the next record
+    shows where it went. Nothing is timed. */
+static void iplc_sim_warm(sim_t *sim, const trace_record_t *rec) {
+    switch (rec->itype) {
+        case RTYPE:
+            sim->inst_stats.rtype++;
+            break;
+        case LW:
+            if (sim->config.data_cache != DCACHE_NONE)
+                iplc_sim_trap_data_address(sim, rec->instruction_address, rec->data_address);
+            sim->inst_stats.lw++;
+            break;
+        case SW:
+            if (sim->config.data_cache != DCACHE_NONE)
+                iplc_sim_trap_data_address(sim, rec->instruction_address, rec->data_address);
+            sim->inst_stats.sw++;
+            break;
+        case BRANCH:
+            sim->warm_branch = rec->instruction_address;
+            sim->inst_stats.branch++;
+            break;
+        case JUMP:
+            sim->inst_stats.jump++;
+            break;
+        case SYSCALL:
+            sim->inst_stats.syscall++;
+            break;
+        case NOP:
+            sim->inst_stats.nop++;
+            break;
+        default:
+            printf("Bad record type %d at address %x \n", rec->itype, rec->instruction_address);
+            exit(-1);
+    }
+    sim->warmed++;
+}
+
+
+
+//*****Parsing Function*****//
+/*  The text trace is tokenized in place: a token is a (start, length) pair
+    pointing into the line, so nothing is copied or NUL terminated and lines
+    can be any length. Tokens are separated by blanks and never run past the
+    end of their line. */
+typedef struct trace_token {
+    const char* start;
+    size_t length;
+} trace_token_t;
+
+// How the operands of a mnemonic are laid out in the text trace
+enum trace_operands {OPERANDS_NONE, OPERANDS_RTYPE, OPERANDS_LUI, OPERANDS_MEM, OPERANDS_BRANCH, OPERANDS_JUMP_REG};
+
+static inline int iplc_sim_is_blank(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Cut the next token off the front of [*p, end), returns 0 if there is none
+static inline int iplc_sim_next_token(const char **p, const char *end, trace_token_t *token) {
+    const char *s = *p;
+
+    while (s < end && iplc_sim_is_blank(*s))
+        s++;
+
+    token->start = s;
+    while (s < end && !iplc_sim_is_blank(*s))
+        s++;
+
+    token->length = s - token->start;
+    *p = s;
+    return token->length != 0;
+}
+
+// Read a hex number off the front of the token the way %x does, returns 0 if there are no digits
+static inline int iplc_sim_token_hex(trace_token_t token, unsigned int *value) {
+    const char *p = token.start, *end = token.start + token.length;
+    unsigned int result = 0;
+    int digits = 0;
+
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        p += 2;
+
+    for (; p < end; p++, digits++) {
+        char c = *p;
+
+        if (c >= '0' && c <= '9')
+            result = (result << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            result = (result << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            result = (result << 4) | (c - 'A' + 10);
+        else
+            break;
+    }
+
+    *value = result;
+    return digits != 0;
+}
+
+// Turn a "$reg," or constant operand into a number, stopping at the first non-digit like atoi
+static inline int iplc_sim_token_reg(trace_token_t token) {
+    const char *p = token.start, *end = token.start + token.length;
+    int negative = 0;
+    int value = 0;
+
+    if (p < end && *p == '$')
+        p++;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + (*p - '0');
+
+    return negative ? -value : value;
+}
+
+// Pull the base register out of an "offset($reg):" operand, -1 if there is none
+static inline int iplc_sim_token_base_reg(trace_token_t token) {
+    const char *reg = memchr(token.start, '$', token.length);
+
+    if (reg == NULL)
+        return -1;
+
+    token.length -= reg - token.start;
+    token.start = reg;
+    return iplc_sim_token_reg(token);
+}
+
+static inline int iplc_sim_token_starts(trace_token_t token, const char *prefix) {
+    size_t length = strlen(prefix);
+
+    return token.length >= length && memcmp(token.start, prefix, length) == 0;
+}
+
+// Work out the record type and operand layout of a mnemonic from its name
+static void iplc_sim_classify_mnemonic(trace_mnemonics_t *mnemonics, int i, trace_token_t token,
+                                       unsigned int address) {
+    if (iplc_sim_token_starts(token, "add") ||
+        iplc_sim_token_starts(token, "sll") ||
+        iplc_sim_token_starts(token, "ori")) {
+        mnemonics->itype[i] = RTYPE;
+        mnemonics->operands[i] = OPERANDS_RTYPE;
+    }
+    else if (iplc_sim_token_starts(token, "lui")) {
+        mnemonics->itype[i] = RTYPE;
+        mnemonics->operands[i] = OPERANDS_LUI;
+    }
+    else if (iplc_sim_token_starts(token, "lw") ||
+             iplc_sim_token_starts(token, "sw")) {
+        mnemonics->itype[i] = iplc_sim_token_starts(token, "lw") ? LW : SW;
+        mnemonics->operands[i] = OPERANDS_MEM;
+    }
+    else if (iplc_sim_token_starts(token, "beq")) {
+        mnemonics->itype[i] = BRANCH;
+        mnemonics->operands[i] = OPERANDS_BRANCH;
+    }
+    else if (iplc_sim_token_starts(token, "j")) {
+        /*
+         * jal, jr and j. jr and jalr jump to a register, which the
+         * scoreboard has to see them read.
+         */
+        mnemonics->itype[i] = JUMP;
+        mnemonics->operands[i] = (iplc_sim_token_starts(token, "jr") || iplc_sim_token_starts(token, "jalr")) ?
+                                 OPERANDS_JUMP_REG : OPERANDS_NONE;
+    }
+    else if (iplc_sim_token_starts(token, "syscall")) {
+        mnemonics->itype[i] = SYSCALL;
+        mnemonics->operands[i] = OPERANDS_NONE;
+    }
+    else if (iplc_sim_token_starts(token, "nop")) {
+        mnemonics->itype[i] = NOP;
+        mnemonics->operands[i] = OPERANDS_NONE;
+    }
+    else {
+        printf("Do not know how to process instruction: %s at address %x \n",
+               mnemonics->name[i], address );
+        exit(-1);
+    }
+}
+
+/*  Find the mnemonic in the table, adding and classifying it if this is the
+    first time we have seen it. Traces only use a handful of distinct
+    mnemonics, names longer than the table allows are cut short. */
+static uint8_t iplc_sim_intern_mnemonic(trace_mnemonics_t *mnemonics, trace_token_t token, unsigned int address) {
+    size_t length = token.length < TRACE_MNEMONIC_LEN ? token.length : TRACE_MNEMONIC_LEN - 1;
+    int i;
+
+    for (i = 0; i < mnemonics->count; i++) {
+        if (mnemonics->name[i][0] == token.start[0] &&
+            memcmp(mnemonics->name[i], token.start, length) == 0 &&
+            mnemonics->name[i][length] == '\0')
+            return (uint8_t) i;
+    }
+
+    if (mnemonics->count == TRACE_MAX_MNEMONICS) {
+        printf("Too many distinct instructions in trace (max %d) \n", TRACE_MAX_MNEMONICS);
+        exit(-1);
+    }
+
+    memcpy(mnemonics->name[i], token.start, length);
+    mnemonics->name[i][length] = '\0';
+    iplc_sim_classify_mnemonic(mnemonics, i, token, address);
+    mnemonics->count++;
+    return (uint8_t) i;
+}
+
+/*  Decode the trace line [line, end) into a record. This does all of the
+    string work, so replaying the record later is just a switch on itype. */
+void iplc_sim_decode_line(const char *line, const char *end, trace_record_t *rec, trace_mnemonics_t *mnemonics) {
+    trace_token_t token, operands[3];
+    unsigned int address = 0;
+    unsigned int data_address = 0;
+    const char *instruction;
+    int i;
+
+    if (!iplc_sim_next_token(&line, end, &token) || !iplc_sim_token_hex(token, &address) ||
+        !iplc_sim_next_token(&line, end, &token)) {
+        printf("Malformed instruction \n");
+        exit(-1);
+    }
+
+    memset(rec, 0, sizeof(trace_record_t));
+    rec->instruction_address = address;
+    rec->mnemonic = iplc_sim_intern_mnemonic(mnemonics, token, address);
+    rec->itype = mnemonics->itype[rec->mnemonic];
+    rec->dest_reg = -1;
+    rec->reg1 = -1;
+    rec->reg2_or_constant = -1;
+    instruction = mnemonics->name[rec->mnemonic];
+
+    // Parse the operands
+    switch (mnemonics->operands[rec->mnemonic]) {
+        case OPERANDS_RTYPE:
+            for (i = 0; i < 3; i++) {
+                if (!iplc_sim_next_token(&line, end, &operands[i])) {
+                    printf("Malformed RTYPE instruction (%s) at address 0x%x \n",
+                           instruction, address);
+                    exit(-1);
+                }
+            }
+
+            rec->dest_reg = iplc_sim_token_reg(operands[0]);
+            rec->reg1 = iplc_sim_token_reg(operands[1]);
+            rec->reg2_or_constant = iplc_sim_token_reg(operands[2]);
+            break;
+
+        case OPERANDS_LUI:
+            if (!iplc_sim_next_token(&line, end, &operands[0]) ||
+                !iplc_sim_next_token(&line, end, &operands[1])) {
+                printf("Malformed RTYPE instruction (%s) at address 0x%x \n",
+                       instruction, address );
+                exit(-1);
+            }
+
+            rec->dest_reg = iplc_sim_token_reg(operands[0]);
+            break;
+
+        case OPERANDS_MEM:
+            if (!iplc_sim_next_token(&line, end, &operands[0]) ||
+                !iplc_sim_next_token(&line, end, &operands[1]) ||
+                !iplc_sim_next_token(&line, end, &token) ||
+                !iplc_sim_token_hex(token, &data_address)) {
+                printf("Bad instruction: %s at address %x \n", instruction, address);
+                exit(-1);
+            }
+
+            rec->dest_reg = iplc_sim_token_reg(operands[0]);
+            rec->reg1 = iplc_sim_token_base_reg(operands[1]);
+            rec->data_address = data_address;
+            break;
+
+        case OPERANDS_BRANCH:
+            if (iplc_sim_next_token(&line, end, &operands[0]) &&
+                iplc_sim_next_token(&line, end, &operands[1])) {
+                rec->reg1 = iplc_sim_token_reg(operands[0]);
+                rec->reg2_or_constant = iplc_sim_token_reg(operands[1]);
+            }
+            break;
+
+        case OPERANDS_JUMP_REG:
+            // jr rs, or jalr [rd,] rs, the register jumped to comes last
+            if (iplc_sim_next_token(&line, end, &operands[0])) {
+                if (iplc_sim_next_token(&line, end, &operands[1]))
+                    operands[0] = operands[1];
+                rec->reg1 = iplc_sim_token_reg(operands[0]);
+            }
+            break;
+    }
+}
+
+// Decode one NUL terminated line of the text trace into a record.
+void iplc_sim_decode_instruction(const char *buffer, trace_record_t *rec, trace_mnemonics_t *mnemonics) {
+    iplc_sim_decode_line(buffer, buffer + strcspn(buffer, "\n"), rec, mnemonics);
+}
+
+/*  Fetch the instruction through the cache and send it down the pipeline.
+    Works the same whether the record came from a text or a binary trace. */
+void iplc_sim_process_record(sim_t *sim, const trace_record_t *rec, const trace_mnemonics_t *mnemonics) {
+    int instruction_hit = 0;
+
+    if (sim->interval_ring != NULL)
+        iplc_sim_interval_check(sim);
+
+    sim->instruction_address = rec->instruction_address;
+    instruction_hit = iplc_sim_trap_address(sim, sim->instruction_address );
+
+    // between samples the record only warms the caches and the predictor
+    if (sim->sample_period) {
+        sim->warming = !iplc_sim_sample(sim, rec);
+        if (sim->warming) {
+            iplc_sim_warm(sim, rec);
+            return;
+        }
+    }
+
+    // if a MISS, then push current instruction thru pipeline
+    if (!instruction_hit) {
+        // need to subtract 1, since the stage is pushed once more for actual instruction processing
+        // also need to allow for a branch miss prediction during the fetch cache miss time -- by
+        // counting cycles this allows for these cycles to overlap and not doubly count.
+
+        iplc_sim_event(sim, EVENT_FETCH_MISS, sim->instruction_address, rec->itype, sim->miss_cycles);
+
+        if (sim->ooo == NULL)
+            iplc_sim_advance_pipeline(sim, sim->miss_cycles - 1);
+    }
+    else
+        iplc_sim_event(sim, EVENT_FETCH_HIT, sim->instruction_address, rec->itype, 0);
+
+    // the out-of-order core times the instruction itself, miss and all
+    if (sim->ooo != NULL) {
+        iplc_sim_profile_enter(sim->config.profile, PROFILE_PIPELINE);
+        iplc_sim_ooo_record(sim, rec, mnemonics->name[rec->mnemonic], instruction_hit);
+        iplc_sim_profile_leave(sim->config.profile);
+        return;
+    }
+
+    switch (rec->itype) {
+        case RTYPE:
+            iplc_sim_process_pipeline_rtype(sim, mnemonics->name[rec->mnemonic],
+                                            rec->dest_reg, rec->reg1, rec->reg2_or_constant);
+            break;
+        case LW:
+            // reg1 is the base register of a lw/sw
+            iplc_sim_process_pipeline_lw(sim, rec->dest_reg, rec->reg1, rec->data_address);
+            break;
+        case SW:
+            // a sw's dest_reg is the register it stores
+            iplc_sim_process_pipeline_sw(sim, rec->dest_reg, rec->reg1, rec->data_address);
+            break;
+        case BRANCH:
+            iplc_sim_process_pipeline_branch(sim, rec->reg1, rec->reg2_or_constant);
+            break;
+        case JUMP:
+            iplc_sim_process_pipeline_jump(sim, mnemonics->name[rec->mnemonic], rec->reg1);
+            break;
+        case SYSCALL:
+            iplc_sim_process_pipeline_syscall(sim);
+            break;
+        case NOP:
+            iplc_sim_process_pipeline_nop(sim);
+            break;
+        default:
+            printf("Bad record type %d at address %x \n", rec->itype, rec->instruction_address);
+            exit(-1);
+    }
+}
+
+// Decode and run a single line of the text trace.
+void iplc_sim_parse_instruction(sim_t *sim, char *buffer) {
+    trace_record_t rec;
+
+    iplc_sim_profile_enter(sim->config.profile, PROFILE_PARSE);
+    iplc_sim_decode_instruction(buffer, &rec, &sim->parse_mnemonics);
+    iplc_sim_profile_leave(sim->config.profile);
+    iplc_sim_process_record(sim, &rec, &sim->parse_mnemonics);
+}
+
+
+
+//*****Trace Functions*****//
+// Wrap an already open trace file, working out whether it is text or binary.
+trace_reader_t* iplc_sim_trace_attach(FILE *file) {
+    trace_reader_t *trace = (trace_reader_t*) calloc(1, sizeof(trace_reader_t));
+    trace_header_t header;
+    struct stat st;
+
+    trace->file = file;
+
+    // Only a regular file can be probed for the header and read again, anything else is read as text
+    if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode))
+        return trace;
+
+    rewind(file);
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) == 0) {
+        if (header.version != TRACE_VERSION || header.mnemonic_count > TRACE_MAX_MNEMONICS) {
+            printf("Unsupported binary trace version %u \n", header.version);
+            exit(-1);
+        }
+        if (fread(trace->mnemonics.name, TRACE_MNEMONIC_LEN, TRACE_MAX_MNEMONICS, file) != TRACE_MAX_MNEMONICS) {
+            printf("Truncated binary trace header \n");
+            exit(-1);
+        }
+        if (st.st_size < (off_t) TRACE_DATA_OFFSET ||
+            (st.st_size - TRACE_DATA_OFFSET) % sizeof(trace_record_t) != 0 ||
+            (st.st_size - TRACE_DATA_OFFSET) / sizeof(trace_record_t) != header.record_count) {
+            printf("Truncated binary trace, the header says %llu records \n",
+                   (unsigned long long) header.record_count);
+            exit(-1);
+        }
+        trace->mnemonics.count = header.mnemonic_count;
+        trace->binary = 1;
+    }
+    else if (st.st_size > 0) {
+        void *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+
+        if (text != MAP_FAILED) {
+            madvise(text, st.st_size, MADV_SEQUENTIAL);
+            trace->text = (const char*) text;
+            trace->text_size = st.st_size;
+        }
+    }
+
+    iplc_sim_trace_rewind(trace);
+    return trace;
+}
+
+// Open a trace of either format, NULL if the file can't be opened.
+trace_reader_t* iplc_sim_trace_open(const char *path) {
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL)
+        return NULL;
+
+    return iplc_sim_trace_attach(file);
+}
+
+/*  Hand out the next record. Returns 0 at the end of the trace. Only
+    decoding a text line is charged to the parse phase; replaying a binary
+    trace counts toward whatever phase asked for the record. */
+int iplc_sim_trace_next(trace_reader_t *trace, trace_record_t *rec) {
+    if (trace->text) {
+        const char *line = trace->text + trace->offset;
+        const char *end;
+
+        if (trace->offset == trace->text_size)
+            return 0;
+
+        end = memchr(line, '\n', trace->text_size - trace->offset);
+        if (end == NULL)
+            end = trace->text + trace->text_size;
+
+        trace->offset = end - trace->text;
+        if (trace->offset < trace->text_size)
+            trace->offset++; // past the newline
+
+        iplc_sim_profile_enter(trace->profile, PROFILE_PARSE);
+        iplc_sim_decode_line(line, end, rec, &trace->mnemonics);
+        iplc_sim_profile_leave(trace->profile);
+        return 1;
+    }
+
+    if (!trace->binary) {
+        ssize_t length = getline(&trace->line, &trace->line_size, trace->file);
+
+        if (length < 0)
+            return 0;
+
+        iplc_sim_profile_enter(trace->profile, PROFILE_PARSE);
+        iplc_sim_decode_line(trace->line, trace->line + length, rec, &trace->mnemonics);
+        iplc_sim_profile_leave(trace->profile);
+        return 1;
+    }
+
+    if (trace->record_pos == trace->record_count) {
+        ssize_t bytes = pread(fileno(trace->file), trace->records, sizeof(trace->records), trace->offset);
+
+        if (bytes < 0) {
+            printf("Failed reading binary trace \n");
+            exit(-1);
+        }
+
+        trace->offset += bytes;
+        trace->record_count = bytes / sizeof(trace_record_t);
+        trace->record_pos = 0;
+        if (trace->record_count == 0)
+            return 0;
+    }
+
+    *rec = trace->records[trace->record_pos++];
+    return 1;
+}
+
+/*  Make an independent reader over the same binary or mapped text trace,
+    starting at the beginning. The clone must be closed before the reader
+    it came from. */
+trace_reader_t* iplc_sim_trace_clone(trace_reader_t *trace) {
+    trace_reader_t *clone = (trace_reader_t*) malloc(sizeof(trace_reader_t));
+
+    if (!trace->binary && !trace->text) {
+        printf("Only binary or mapped traces can be shared between simulations \n");
+        exit(-1);
+    }
+
+    memcpy(clone, trace, sizeof(trace_reader_t));
+    clone->shared = 1;
+    clone->line = NULL;
+    clone->line_size = 0;
+    clone->profile = NULL; // a clone is read on another thread
+    iplc_sim_trace_rewind(clone);
+    return clone;
+}
+
+// Start handing out records from the beginning of the trace again
+void iplc_sim_trace_rewind(trace_reader_t *trace) {
+    if (trace->binary)
+        trace->offset = TRACE_DATA_OFFSET;
+    else if (trace->text)
+        trace->offset = 0;
+    else
+        fseek(trace->file, 0, SEEK_SET);
+    trace->record_count = 0;
+    trace->record_pos = 0;
+}
+
+/*  Where the next record starts, a byte offset into the file. Returns -1
+    for text that is read a line at a time from something unseekable. */
+off_t iplc_sim_trace_tell(trace_reader_t *trace) {
+    if (trace->binary)
+        return trace->offset - (off_t) ((trace->record_count - trace->record_pos) * sizeof(trace_record_t));
+    if (trace->text)
+        return trace->offset;
+    return ftello(trace->file);
+}
+
+/*  Carry on handing out records from an offset iplc_sim_trace_tell() gave.
+    A text trace also needs the mnemonic table it had at that point. */
+void iplc_sim_trace_seek(trace_reader_t *trace, off_t offset) {
+    off_t start = trace->binary ? (off_t) TRACE_DATA_OFFSET : 0;
+    off_t end = -1;
+    struct stat st;
+
+    if (trace->text)
+        end = trace->text_size;
+    else if (fstat(fileno(trace->file), &st) == 0)
+        end = st.st_size;
+
+    // the offset has to be the start of a record inside this trace
+    if (offset < start || offset > end ||
+        (trace->binary && (offset - start) % sizeof(trace_record_t) != 0) ||
+        (trace->text && offset > 0 && trace->text[offset - 1] != '\n')) {
+        printf("Offset %lld is not the start of a record in the trace \n", (long long) offset);
+        exit(-1);
+    }
+
+    if (trace->binary || trace->text)
+        trace->offset = offset;
+    else
+        fseeko(trace->file, offset, SEEK_SET);
+    trace->record_count = 0;
+    trace->record_pos = 0;
+}
+
+void iplc_sim_trace_close(trace_reader_t *trace) {
+    if (!trace->shared) {
+        if (trace->text)
+            munmap((void*) trace->text, trace->text_size);
+        fclose(trace->file);
+    }
+    free(trace->line);
+    free(trace);
+}
+
+/*  Decode every record of the trace and write it out in the binary format.
+    The output must be seekable since the header is filled in last.
+    Returns the number of records written. */
+long iplc_sim_trace_convert(trace_reader_t *trace, FILE *out) {
+    trace_header_t header;
+    trace_record_t rec;
+    long count = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+
+    // Leave room for the header and mnemonic table, we only know them at the end
+    fseek(out, TRACE_DATA_OFFSET, SEEK_SET);
+
+    iplc_sim_trace_rewind(trace);
+    while (iplc_sim_trace_next(trace, &rec)) {
+        fwrite(&rec, sizeof(rec), 1, out);
+        count++;
+    }
+
+    header.mnemonic_count = trace->mnemonics.count;
+    header.record_count = count;
+
+    fseek(out, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(trace->mnemonics.name, TRACE_MNEMONIC_LEN, TRACE_MAX_MNEMONICS, out);
+    fflush(out);
+
+    if (ferror(out)) {
+        printf("Failed writing binary trace \n");
+        exit(-1);
+    }
+
+    return count;
+}
+
+/*  Synthetic traces for benchmarking, each a small loop whose loads have the
+    locality of its pattern, over footprint bytes of data:
+        stream  a[i] is read and b[i] written, each array half of the data
+        stride  every stride bytes through the data, a word further on each pass
+        random  anywhere in the data
+        loop    a nest summing 16 word rows of a matrix against one reused row
+        chase   a linked list of stride byte nodes in random order, each load
+                waiting on the one before */
+static const unsigned int generate_code = 0x00400000;
+static const unsigned int generate_data = 0x10010000;
+
+// Write one line of a synthetic trace, 0 once it has all of its records
+static int iplc_sim_generate_line(FILE *out, long *left, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(out, format, args);
+    va_end(args);
+    return --*left > 0;
+}
+
+/*  Write a text trace of records instructions with the given pattern. The
+    footprint is a power of two, the stride a multiple of 4 at most half of it.
+    Returns the number of records written. */
+long iplc_sim_trace_generate(FILE *out, int pattern, long records, long footprint, int stride) {
+    const unsigned int pc = generate_code, base = generate_data;
+    unsigned int words = footprint / 4;
+    uint64_t rng = 88172645463325252ull;
+    unsigned int i = 0, column = 0, row = 0, node = 0;
+    long left = records;
+
+    if (records < 1)
+        return 0;
+
+    switch (pattern) {
+        case PATTERN_STREAM:
+            // b[] starts a line on from a[] so the two don't meet in the same set of a direct mapped cache
+            while (iplc_sim_generate_line(out, &left, "0x%08x  lw $8, 0($4): %08x\n", pc, base + 4 * i) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  addu $9, $9, $8\n", pc + 4) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  sw $9, 0($5): %08x\n", pc + 8,
+                                          base + 2 * words + (4 * i + 64) % (2 * words)) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  addiu $4, $4, 4\n", pc + 12) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  addiu $5, $5, 4\n", pc + 16) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  beq $4, $6, -24\n", pc + 20)) {
+                if (++i == words / 2) {
+                    i = 0;
+                    if (!iplc_sim_generate_line(out, &left, "0x%08x  j 0x%08x\n", pc + 24, pc))
+                        break;
+                }
+            }
+            break;
+
+        case PATTERN_STRIDE:
+            while (iplc_sim_generate_line(out, &left, "0x%08x  lw $8, 0($4): %08x\n", pc,
+                                          base + i * stride + column) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  addu $9, $9, $8\n", pc + 4) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  addiu $4, $4, %d\n", pc + 8, stride) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  beq $4, $6, -12\n", pc + 12)) {
+                if (++i == footprint / stride) {
+                    i = 0;
+                    column = (column + 4) % stride;
+                    if (!iplc_sim_generate_line(out, &left, "0x%08x  j 0x%08x\n", pc + 16, pc))
+                        break;
+                }
+            }
+            break;
+
+        case PATTERN_RANDOM:
+            do {
+                rng ^= rng >> 12;
+                rng ^= rng << 25;
+                rng ^= rng >> 27;
+                i = (unsigned int) ((rng * 0x2545F4914F6CDD1Dull) >> 32) & (words - 1);
+            } while (iplc_sim_generate_line(out, &left, "0x%08x  lw $8, 0($4): %08x\n", pc, base + 4 * i) &&
+                     iplc_sim_generate_line(out, &left, "0x%08x  sll $10, $8, 2\n", pc + 4) &&
+                     iplc_sim_generate_line(out, &left, "0x%08x  addu $4, $10, $11\n", pc + 8) &&
+                     iplc_sim_generate_line(out, &left, "0x%08x  beq $4, $6, -12\n", pc + 12));
+            break;
+
+        case PATTERN_LOOP:
+            // the matrix fills the footprint, the reused row sits just past it
+            while (iplc_sim_generate_line(out, &left, "0x%08x  lw $8, 0($4): %08x\n", pc,
+                                          base + 64 * row + 4 * column) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  lw $10, 0($5): %08x\n", pc + 4,
+                                          base + footprint + 4 * column) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  addu $9, $8, $10\n", pc + 8) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  addiu $4, $4, 4\n", pc + 12) &&
+                   iplc_sim_generate_line(out, &left, "0x%08x  beq $4, $6, -16\n", pc + 16)) {
+                if (++column == 16) {
+                    column = 0;
+                    if (++row == words / 16)
+                        row = 0;
+                    if (!iplc_sim_generate_line(out, &left, "0x%08x  addiu $7, $7, 64\n", pc + 20) ||
+                        !iplc_sim_generate_line(out, &left, "0x%08x  beq $7, $6, -24\n", pc + 24))
+                        break;
+                    if (row == 0 && !iplc_sim_generate_line(out, &left, "0x%08x  j 0x%08x\n", pc + 28, pc))
+                        break;
+                }
+            }
+            break;
+
+        case PATTERN_CHASE:
+            // a full period LCG over the nodes visits each of them once per lap
+            do {
+                node = (node * 1664525u + 1013904223u) & (footprint / stride - 1);
+            } while (iplc_sim_generate_line(out, &left, "0x%08x  lw $4, 0($4): %08x\n", pc, base + node * stride) &&
+                     iplc_sim_generate_line(out, &left, "0x%08x  addiu $9, $9, 1\n", pc + 4) &&
+                     iplc_sim_generate_line(out, &left, "0x%08x  beq $4, $0, -8\n", pc + 8));
+            break;
+    }
+
+    fflush(out);
+    if (ferror(out)) {
+        printf("Failed writing synthetic trace \n");
+        exit(-1);
+    }
+
+    return records;
+}
+
+//*****Checkpoint Functions*****//
+/*  A checkpoint is this header, the sim_t as it was, the trace's mnemonic
+    table and then every block iplc_sim_checkpoint_blocks() lists, all in
+    host byte order. It only restores into the same build, into a simulator
+    whose caches, pipeline, predictor and core have the same shape. */
+typedef struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sim_bytes;     // sizeof(sim_t)
+    uint32_t binary;        // the trace was binary
+    uint32_t ooo_bytes;     // sizeof(ooo_t), 0 without the out-of-order core
+    uint64_t trace_offset;  // where the next record starts, see iplc_sim_trace_tell()
+    uint64_t trace_bytes;   // size of the trace file
+    uint64_t trace_hash;    // FNV-1a of its first CHECKPOINT_TRACE_PROBE bytes
+} checkpoint_header_t;
+
+typedef struct checkpoint_block {
+    void *data;
+    size_t bytes;
+} checkpoint_block_t;
+
+// What a checkpoint holds besides sim_t and ooo_t themselves, in file order. Returns how many blocks
+static int iplc_sim_checkpoint_blocks(sim_t *sim, checkpoint_block_t *blocks) {
+    predictor_t *pred = &sim->predictor;
+    size_t entries = 1ul << pred->bits;
+    size_t patterns = 1ul << pred->history_bits;
+    int i, n = 0;
+
+    blocks[n++] = (checkpoint_block_t) {sim->cache.sets, sim->cache.set_bytes << sim->cache.index};
+    if (sim->config.data_cache == DCACHE_SPLIT)
+        blocks[n++] = (checkpoint_block_t) {sim->dcache.sets, sim->dcache.set_bytes << sim->dcache.index};
+    for (i = 0; i < sim->config.levels; i++)
+        blocks[n++] = (checkpoint_block_t) {sim->level[i].sets, sim->level[i].set_bytes << sim->level[i].index};
+
+    if (pred->counters)
+        blocks[n++] = (checkpoint_block_t) {pred->counters, pred->local ? patterns : entries};
+    if (pred->local) {
+        blocks[n++] = (checkpoint_block_t) {pred->local, patterns};
+        blocks[n++] = (checkpoint_block_t) {pred->local_history, entries * sizeof(uint32_t)};
+        blocks[n++] = (checkpoint_block_t) {pred->chooser, patterns};
+    }
+    if (pred->btb_bits) {
+        blocks[n++] = (checkpoint_block_t) {pred->btb_tag, (1ul << pred->btb_bits) * sizeof(uint32_t)};
+        blocks[n++] = (checkpoint_block_t) {pred->btb_target, (1ul << pred->btb_bits) * sizeof(uint32_t)};
+    }
+
+    if (sim->ooo != NULL) {
+        blocks[n++] = (checkpoint_block_t) {sim->ooo->rob, sim->ooo->rob_size * sizeof(uint64_t)};
+        blocks[n++] = (checkpoint_block_t) {sim->ooo->lsq, sim->ooo->lsq_size * sizeof(uint64_t)};
+        blocks[n++] = (checkpoint_block_t) {sim->ooo->iq, sim->ooo->iq_size * sizeof(uint64_t)};
+        blocks[n++] = (checkpoint_block_t) {sim->ooo->slots, OOO_ISSUE_SLOTS * sizeof(ooo_slot_t)};
+    }
+    return n;
+}
+
+/*  What a checkpoint knows its trace by: the size of the file and a hash of
+    its first few KB, which for a text trace covers its first lines and for
+    a binary one the mnemonic table. Returns the hash. */
+static uint64_t iplc_sim_checkpoint_trace_hash(trace_reader_t *trace, uint64_t *bytes) {
+    uint8_t probe[CHECKPOINT_TRACE_PROBE];
+    uint64_t hash = 0xcbf29ce484222325ull;
+    struct stat st;
+    ssize_t n, i;
+
+    *bytes = (fstat(fileno(trace->file), &st) == 0) ? (uint64_t) st.st_size : 0;
+    n = pread(fileno(trace->file), probe, sizeof(probe), 0);
+    for (i = 0; i < n; i++)
+        hash = (hash ^ probe[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+static void iplc_sim_checkpoint_write(FILE *file, const void *data, size_t bytes) {
+    if (fwrite(data, 1, bytes, file) != bytes) {
+        printf("Failed writing checkpoint \n");
+        exit(-1);
+    }
+}
+
+static void iplc_sim_checkpoint_read(FILE *file, void *data, size_t bytes) {
+    if (fread(data, 1, bytes, file) != bytes) {
+        printf("Truncated checkpoint \n");
+        exit(-1);
+    }
+}
+
+/*  Write everything the simulator has built up so far to path, along with
+    where in the trace it got to, so a run can carry on from there later. */
+void iplc_sim_checkpoint_save(sim_t *sim, trace_reader_t *trace, const char *path) {
+    checkpoint_block_t blocks[CHECKPOINT_MAX_BLOCKS];
+    checkpoint_header_t header;
+    FILE *file;
+    off_t offset = iplc_sim_trace_tell(trace);
+    int i, n = iplc_sim_checkpoint_blocks(sim, blocks);
+
+    if (offset < 0) {
+        printf("Can't checkpoint a trace that can't be seeked \n");
+        exit(-1);
+    }
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("fopen failed for %s file\n", path);
+        exit(-1);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.sim_bytes = sizeof(sim_t);
+    header.binary = trace->binary;
+    header.ooo_bytes = (sim->ooo != NULL) ? sizeof(ooo_t) : 0;
+    header.trace_offset = offset;
+    header.trace_hash = iplc_sim_checkpoint_trace_hash(trace, &header.trace_bytes);
+
+    iplc_sim_checkpoint_write(file, &header, sizeof(header));
+    iplc_sim_checkpoint_write(file, sim, sizeof(sim_t));
+    iplc_sim_checkpoint_write(file, &trace->mnemonics, sizeof(trace->mnemonics));
+    if (sim->ooo != NULL)
+        iplc_sim_checkpoint_write(file, sim->ooo, sizeof(ooo_t));
+    for (i = 0; i < n; i++)
+        iplc_sim_checkpoint_write(file, blocks[i].data, blocks[i].bytes);
+
+    if (fclose(file) != 0) {
+        printf("Failed writing checkpoint \n");
+        exit(-1);
+    }
+}
+
+// Two caches hold their sets the same way, the policies are compared by the caller
+static inline int iplc_sim_cache_same_shape(const cache_t *a, const cache_t *b) {
+    return a->index == b->index && a->blocksize == b->blocksize && a->assoc == b->assoc &&
+           a->set_bytes == b->set_bytes && a->lines == b->lines;
+}
+
+/*  A saved cache takes over the live one's sets and policy, the pointers of
+    another process mean nothing here, and its latency. */
+static inline void iplc_sim_cache_adopt(cache_t *saved, const cache_t *live) {
+    saved->sets = live->sets;
+    saved->replacement = live->replacement;
+    saved->latency = live->latency;
+    saved->set_stats = live->set_stats;
+    saved->profile = live->profile;
+}
+
+/*  Bring a simulator freshly made for the same shape of caches, pipeline,
+    predictor and core back to the state saved in path, and move the trace
+    to the record after the last one it had seen. Its configuration and
+    anything that only affects timing from here on are its own. */
+void iplc_sim_checkpoint_restore(sim_t *sim, trace_reader_t *trace, const char *path) {
+    checkpoint_block_t blocks[CHECKPOINT_MAX_BLOCKS];
+    checkpoint_header_t header;
+    uint64_t trace_bytes, trace_hash;
+    sim_t *saved = (sim_t*) malloc(sizeof(sim_t));
+    predictor_t pred = sim->predictor;
+    sim_config_t config = sim->config;
+    ooo_t *ooo = sim->ooo;
+    ooo_t live;
+    FILE *file = fopen(path, "rb");
+    int i, n, same;
+
+    if (saved == NULL) {
+        printf("Out of memory restoring checkpoint \n");
+        exit(-1);
+    }
+    if (file == NULL) {
+        printf("fopen failed for %s file\n", path);
+        exit(-1);
+    }
+
+    iplc_sim_checkpoint_read(file, &header, sizeof(header));
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION ||
+        header.sim_bytes != sizeof(sim_t)) {
+        printf("%s is not a checkpoint this simulator can restore \n", path);
+        exit(-1);
+    }
+    trace_hash = iplc_sim_checkpoint_trace_hash(trace, &trace_bytes);
+    if (header.trace_bytes != trace_bytes || header.trace_hash != trace_hash) {
+        printf("The checkpoint was taken on another trace \n");
+        exit(-1);
+    }
+    iplc_sim_checkpoint_read(file, saved, sizeof(sim_t));
+
+    same = header.binary == (uint32_t) trace->binary &&
+           header.ooo_bytes == ((ooo != NULL) ? sizeof(ooo_t) : 0) &&
+           saved->config.data_cache == config.data_cache && saved->config.levels == config.levels &&
+           saved->config.replacement == config.replacement && iplc_sim_cache_same_shape(&saved->cache, &sim->cache) &&
+           saved->pipeline_depth == sim->pipeline_depth && saved->width == sim->width &&
+           saved->config.predictor == config.predictor && saved->predictor.bits == pred.bits &&
+           saved->predictor.history_bits == pred.history_bits && saved->predictor.btb_bits == pred.btb_bits;
+    if (config.data_cache == DCACHE_SPLIT)
+        same = same && iplc_sim_cache_same_shape(&saved->dcache, &sim->dcache);
+    for (i = 0; i < config.levels && same; i++)
+        same = saved->config.level[i].replacement == config.level[i].replacement &&
+               iplc_sim_cache_same_shape(&saved->level[i], &sim->level[i]);
+    if (!same) {
+        printf("The checkpoint was taken with differently shaped caches, pipeline, predictor or core \n");
+        exit(-1);
+    }
+
+    // Everything pointing at this process's memory stays, the rest comes from the checkpoint
+    iplc_sim_cache_adopt(&saved->cache, &sim->cache);
+    iplc_sim_cache_adopt(&saved->dcache, &sim->dcache);
+    for (i = 0; i < CACHE_MAX_LEVELS - 1; i++)
+        iplc_sim_cache_adopt(&saved->level[i], &sim->level[i]);
+
+    saved->predictor.ops = pred.ops;
+    saved->predictor.static_taken = pred.static_taken;
+    saved->predictor.counters = pred.counters;
+    saved->predictor.local = pred.local;
+    saved->predictor.local_history = pred.local_history;
+    saved->predictor.chooser = pred.chooser;
+    saved->predictor.btb_tag = pred.btb_tag;
+    saved->predictor.btb_target = pred.btb_target;
+
+    // ... and so does what only times the instructions from here on
+    saved->config = config;
+    saved->memory_latency = sim->memory_latency;
+    saved->branch_stage = sim->branch_stage;
+    saved->mem_stage = sim->mem_stage;
+    saved->mem_ports = sim->mem_ports;
+    saved->branch_units = sim->branch_units;
+    saved->branch_predict_taken = sim->branch_predict_taken;
+    saved->sample_period = sim->sample_period;
+    saved->sample_window = sim->sample_window;
+    saved->sample_warmup = sim->sample_warmup;
+    saved->dump_pipeline = sim->dump_pipeline;
+    saved->ooo = ooo;
+    saved->out = sim->out;
+    saved->events = sim->events;
+    saved->ring = sim->ring;
+    saved->pc_stats = sim->pc_stats;
+    saved->interval_ring = sim->interval_ring;
+    *sim = *saved;
+    free(saved);
+
+    iplc_sim_checkpoint_read(file, &trace->mnemonics, sizeof(trace->mnemonics));
+    if (ooo != NULL) {
+        live = *ooo;
+        iplc_sim_checkpoint_read(file, ooo, sizeof(ooo_t));
+        if (ooo->rob_size != live.rob_size || ooo->iq_size != live.iq_size || ooo->lsq_size != live.lsq_size) {
+            printf("The checkpoint was taken with differently shaped caches, pipeline, predictor or core \n");
+            exit(-1);
+        }
+        memcpy(ooo->latency, live.latency, sizeof(ooo->latency));
+        ooo->rob = live.rob;
+        ooo->lsq = live.lsq;
+        ooo->iq = live.iq;
+        ooo->slots = live.slots;
+    }
+
+    n = iplc_sim_checkpoint_blocks(sim, blocks);
+    for (i = 0; i < n; i++)
+        iplc_sim_checkpoint_read(file, blocks[i].data, blocks[i].bytes);
+    fclose(file);
+
+    // intervals are counted from where the checkpoint left off
+    if (sim->interval_ring != NULL)
+        iplc_sim_interval_start(sim);
+
+    iplc_sim_trace_seek(trace, (off_t) header.trace_offset);
+}
+
+
+
+//*****Stack Distance Functions*****//
+/*  Mattson's stack algorithm. With LRU replacement an access hits in an
+    assoc-way cache exactly when fewer than assoc other lines of its set were
+    touched since the last access to it (its stack distance). One pass that
+    measures the distance of every access therefore gives the miss rate of
+    every associativity, and keeping one set of stacks per index width gives
+    every cache size at once. Index width 0 is a single stack over every
+    line, the fully associative cache of every size.
+
+    Each set keeps a Fenwick tree over its own access times holding a 1 at
+    the last access of every line, so a distance is two prefix sums. */
+
+#define SD_INITIAL_SET_SIZE 16
+
+typedef struct sd_set {
+    uint32_t* tree; // Fenwick tree over access times, 1 where a line was last touched
+    uint32_t* tags; // tag accessed at each time
+    uint32_t size;  // capacity of tree and tags, a power of two
+    uint32_t time;  // time of the next access to this set, starting at 1
+} sd_set_t;
+
+// Open addressing map from a line to the last time it was touched
+typedef struct sd_map {
+    uint64_t* keys; // line key + 1, 0 marks an empty slot
+    uint32_t* times;
+    uint64_t mask;
+    uint64_t count;
+} sd_map_t;
+
+// The stacks of one index width
+typedef struct sd_level {
+    int index;
+    sd_set_t* sets;
+    sd_map_t map;
+    long* hist; // hist[d] is the number of accesses at stack distance d < max_assoc,
+                // for index 0 hist[k] those below 2^k lines but not below 2^(k-1)
+} sd_level_t;
+
+typedef struct sd {
+    int blocksize;
+    int blockoffsetbits;
+    int max_index;
+    int max_assoc;
+    int full_bins; // of the index 0 hist, up to max_assoc << max_index lines
+    long accesses;
+    sd_level_t* levels; // levels[i] covers i index bits, levels[0] is fully associative
+} sd_t;
+
+static inline void sd_tree_add(uint32_t* tree, uint32_t size, uint32_t i, int32_t delta) {
+    for (; i <= size; i += i & -i)
+        tree[i] += delta;
+}
+
+static inline uint32_t sd_tree_sum(const uint32_t* tree, uint32_t i) {
+    uint32_t sum = 0;
+
+    for (; i > 0; i -= i & -i)
+        sum += tree[i];
+    return sum;
+}
+
+static inline uint64_t sd_map_slot(const sd_map_t* map, uint64_t key) {
+    uint64_t h = key * 0x9E3779B97F4A7C15ull;
+    uint64_t slot = (h ^ (h >> 29)) & map->mask;
+
+    while (map->keys[slot] != 0 && map->keys[slot] != key + 1)
+        slot = (slot + 1) & map->mask;
+    return slot;
+}
+
+static void sd_map_init(sd_map_t* map, uint64_t capacity) {
+    map->keys = (uint64_t*) calloc(capacity, sizeof(uint64_t));
+    map->times = (uint32_t*) malloc(capacity * sizeof(uint32_t));
+    map->mask = capacity - 1;
+    map->count = 0;
+
+    if (map->keys == NULL || map->times == NULL) {
+        printf("Out of memory in stack distance map \n");
+        exit(-1);
     }
-    
-    else if (strncmp( instruction, "lui", 3 ) == 0) {
-        if (sscanf(buffer, "%x %s %s %s",
-                   &instruction_address,
-                   instruction,
-                   str_dest_reg,
-                   str_constant ) != 4 ) {
-            printf("Malformed RTYPE instruction (%s) at address 0x%x \n",
-                   instruction, instruction_address );
-            exit(-1);
+}
+
+static void sd_map_grow(sd_map_t* map) {
+    sd_map_t old = *map;
+    uint64_t i;
+
+    sd_map_init(map, (old.mask + 1) * 2);
+    for (i = 0; i <= old.mask; i++) {
+        if (old.keys[i] != 0) {
+            uint64_t slot = sd_map_slot(map, old.keys[i] - 1);
+            map->keys[slot] = old.keys[i];
+            map->times[slot] = old.times[i];
+            map->count++;
         }
-        
-        dest_reg = iplc_sim_parse_reg(str_dest_reg);
-        src_reg = -1;
-        src_reg2 = -1;
-        iplc_sim_process_pipeline_rtype(instruction, dest_reg, src_reg, src_reg2);
     }
-    
-    else if (strncmp( instruction, "lw", 2 ) == 0 ||
-             strncmp( instruction, "sw", 2 ) == 0  ) {
-        if ( sscanf( buffer, "%x %s %s %s %x",
-                    &instruction_address,
-                    instruction,
-                    reg1,
-                    offsetwithreg,
-                    &data_address ) != 5) {
-            printf("Bad instruction: %s at address %x \n", instruction, instruction_address);
-            exit(-1);
+    free(old.keys);
+    free(old.times);
+}
+
+static inline uint64_t sd_key(int set, int tag) {
+    return ((uint64_t) set << 32) | (uint32_t) tag;
+}
+
+/*  A set has used up its time stamps. Renumber its live lines 1..n in the
+    same order, doubling the capacity if more than half of it is live. */
+static void sd_set_compact(sd_level_t* level, int set) {
+    sd_set_t* s = &level->sets[set];
+    uint32_t live = sd_tree_sum(s->tree, s->size);
+    uint32_t size = (live * 2 > s->size) ? s->size * 2 : s->size;
+    uint32_t* tree = (uint32_t*) calloc(size + 1, sizeof(uint32_t));
+    uint32_t* tags = (uint32_t*) malloc((size + 1) * sizeof(uint32_t));
+    uint32_t t, n = 0;
+
+    if (tree == NULL || tags == NULL) {
+        printf("Out of memory in stack distance set \n");
+        exit(-1);
+    }
+
+    for (t = 1; t < s->time; t++) {
+        uint64_t slot = sd_map_slot(&level->map, sd_key(set, s->tags[t]));
+
+        if (level->map.times[slot] == t) {
+            n++;
+            tags[n] = s->tags[t];
+            tree[n] = 1;
+            level->map.times[slot] = n;
         }
-        
-        if (strncmp(instruction, "lw", 2 ) == 0) {
-            
-            dest_reg = iplc_sim_parse_reg(reg1);
-            
-            // Don't need to worry about base regs -- just insert -1 values
-            iplc_sim_process_pipeline_lw(dest_reg, -1, data_address);
-        }
-        if (strncmp( instruction, "sw", 2 ) == 0) {
-            src_reg = iplc_sim_parse_reg(reg1);
-            
-            // don't need to worry about base regs -- just insert -1 values
-            iplc_sim_process_pipeline_sw( src_reg, -1, data_address);
-        }
-    }
-    else if (strncmp( instruction, "beq", 3 ) == 0) {
-        // don't need to worry about getting regs -- just insert -1 values
-        iplc_sim_process_pipeline_branch(-1, -1);
-    }
-    else if (strncmp( instruction, "jal", 3 ) == 0 ||
-             strncmp( instruction, "jr", 2 ) == 0 ||
-             strncmp( instruction, "j", 1 ) == 0 ) {
-        iplc_sim_process_pipeline_jump( instruction );
-    }
-    else if (strncmp( instruction, "jal", 3 ) == 0 ||
-             strncmp( instruction, "jr", 2 ) == 0 ||
-             strncmp( instruction, "j", 1 ) == 0 ) {
-        /*
-         * Note: no need to worry about forwarding on the jump register
-         * we'll let that one go.
-         */
-        iplc_sim_process_pipeline_jump(instruction);
     }
-    else if ( strncmp( instruction, "syscall", 7 ) == 0) {
-        iplc_sim_process_pipeline_syscall( );
+
+    // Build the Fenwick tree in place from the point values
+    for (t = 1; t <= size; t++) {
+        uint32_t parent = t + (t & -t);
+        if (parent <= size)
+            tree[parent] += tree[t];
+    }
+
+    free(s->tree);
+    free(s->tags);
+    s->tree = tree;
+    s->tags = tags;
+    s->size = size;
+    s->time = n + 1;
+}
+
+sd_t* iplc_sim_sd_create(int blocksize, int max_index, int max_assoc) {
+    sd_t* sd = (sd_t*) calloc(1, sizeof(sd_t));
+    int i;
+
+    sd->blocksize = blocksize;
+    sd->blockoffsetbits = iplc_sim_cache_blockoffsetbits(blocksize);
+    sd->max_index = max_index;
+    sd->max_assoc = max_assoc;
+    sd->full_bins = max_index + __builtin_ctz(max_assoc) + 1;
+    sd->levels = (sd_level_t*) calloc(max_index + 1, sizeof(sd_level_t));
+
+    for (i = 0; i <= max_index; i++) {
+        sd->levels[i].index = i;
+        sd->levels[i].sets = (sd_set_t*) calloc(1 << i, sizeof(sd_set_t));
+        sd->levels[i].hist = (long*) calloc(i ? max_assoc : sd->full_bins, sizeof(long));
+        sd_map_init(&sd->levels[i].map, 1024);
+    }
+    return sd;
+}
+
+void iplc_sim_sd_destroy(sd_t* sd) {
+    int i, j;
+
+    for (i = 0; i <= sd->max_index; i++) {
+        for (j = 0; j < (1 << i); j++) {
+            free(sd->levels[i].sets[j].tree);
+            free(sd->levels[i].sets[j].tags);
+        }
+        free(sd->levels[i].sets);
+        free(sd->levels[i].hist);
+        free(sd->levels[i].map.keys);
+        free(sd->levels[i].map.times);
+    }
+    free(sd->levels);
+    free(sd);
+}
+
+// Measure the stack distance of one access at every index width
+void iplc_sim_sd_access(sd_t* sd, unsigned int address) {
+    int i;
+
+    sd->accesses++;
+
+    for (i = 0; i <= sd->max_index; i++) {
+        sd_level_t* level = &sd->levels[i];
+        int set = iplc_sim_cache_set(level->index, sd->blockoffsetbits, address);
+        int tag = iplc_sim_cache_tag(level->index, sd->blockoffsetbits, address);
+        sd_set_t* s = &level->sets[set];
+        uint64_t slot;
+
+        if (s->tree == NULL) {
+            s->size = SD_INITIAL_SET_SIZE;
+            s->time = 1;
+            s->tree = (uint32_t*) calloc(s->size + 1, sizeof(uint32_t));
+            s->tags = (uint32_t*) malloc((s->size + 1) * sizeof(uint32_t));
+        } else if (s->time > s->size) {
+            sd_set_compact(level, set);
+        }
+
+        slot = sd_map_slot(&level->map, sd_key(set, tag));
+        if (level->map.keys[slot] != 0) {
+            // Seen before: count the distinct lines touched since then
+            uint32_t last = level->map.times[slot];
+            uint32_t distance = sd_tree_sum(s->tree, s->time - 1) - sd_tree_sum(s->tree, last);
+
+            if (level->index == 0) {
+                int bin = distance ? 32 - __builtin_clz(distance) : 0;
+
+                if (bin < sd->full_bins)
+                    level->hist[bin]++;
+            }
+            else if (distance < (uint32_t) sd->max_assoc)
+                level->hist[distance]++;
+            sd_tree_add(s->tree, s->size, last, -1);
+        } else {
+            // First touch is a miss at every associativity
+            level->map.keys[slot] = sd_key(set, tag) + 1;
+            level->map.count++;
+        }
+
+        level->map.times[slot] = s->time;
+        s->tags[s->time] = tag;
+        sd_tree_add(s->tree, s->size, s->time, 1);
+        s->time++;
+
+        if (level->map.count * 2 > level->map.mask)
+            sd_map_grow(&level->map);
     }
-    else if ( strncmp( instruction, "nop", 3 ) == 0) {
-        iplc_sim_process_pipeline_nop( );
+}
+
+/*  Miss rate of an LRU cache with the given index width and associativity.
+    Index 0 is fully associative, assoc being its lines, a power of two. */
+double iplc_sim_sd_miss_rate(sd_t* sd, int index, int assoc) {
+    long hits = 0;
+    int d;
+
+    if (sd->accesses == 0)
+        return 0;
+
+    if (index == 0) {
+        for (d = 0; d < sd->full_bins && (1l << d) <= assoc; d++)
+            hits += sd->levels[0].hist[d];
     }
     else {
-        printf("Do not know how to process instruction: %s at address %x \n",
-               instruction, instruction_address );
+        for (d = 0; d < assoc && d < sd->max_assoc; d++)
+            hits += sd->levels[index].hist[d];
+    }
+    return (double) (sd->accesses - hits) / (double) sd->accesses;
+}
+
+/* runs the stack distance analysis over the trace and prints the miss rate of every cache */
+void run_sd(char* tracefile, int blocksize, int max_index, int max_assoc) {
+
+    trace_reader_t* trace = iplc_sim_trace_open(tracefile);
+    trace_record_t rec;
+    sd_t* sd;
+    const char* padding = "--------------------------------------------------------------------------------";
+    int index, assoc;
+    long lines;
+
+    if (trace == NULL) {
+        printf("fopen failed for %s file\n", tracefile);
+        exit(-1);
+    }
+
+    sd = iplc_sim_sd_create(blocksize, max_index, max_assoc);
+
+    while (iplc_sim_trace_next(trace, &rec)) {
+        iplc_sim_sd_access(sd, rec.instruction_address);
+    }
+
+    printf("\n");
+    printf("Stack Distance Analysis (block size %d, %ld accesses):\n", blocksize, sd->accesses);
+    printf("  LRU cache miss rate by index bits and associativity\n");
+
+    printf("+%.*s", 7, padding);
+    for (assoc = 1; assoc <= max_assoc; assoc *= 2)
+        printf("+%.*s", 10, padding);
+    printf("+\n");
+
+    printf("| index ");
+    for (assoc = 1; assoc <= max_assoc; assoc *= 2)
+        printf("| %2d-way   ", assoc);
+    printf("|\n");
+
+    printf("+%.*s", 7, padding);
+    for (assoc = 1; assoc <= max_assoc; assoc *= 2)
+        printf("+%.*s", 10, padding);
+    printf("+\n");
+
+    for (index = 1; index <= max_index; index++) {
+        printf("| %-5d ", index);
+        for (assoc = 1; assoc <= max_assoc; assoc *= 2)
+            printf("| %f ", iplc_sim_sd_miss_rate(sd, index, assoc));
+        printf("|\n");
+    }
+
+    printf("+%.*s", 7, padding);
+    for (assoc = 1; assoc <= max_assoc; assoc *= 2)
+        printf("+%.*s", 10, padding);
+    printf("+\n");
+
+    // index 0, one set of every line
+    printf("\n");
+    printf("  Fully associative LRU cache miss rate by lines\n");
+    printf("+%.*s+%.*s+\n", 11, padding, 11, padding);
+    printf("| lines     | miss rate |\n");
+    printf("+%.*s+%.*s+\n", 11, padding, 11, padding);
+    for (lines = 1; lines <= (long) max_assoc << max_index; lines *= 2)
+        printf("| %-9ld | %f  |\n", lines, iplc_sim_sd_miss_rate(sd, 0, (int) lines));
+    printf("+%.*s+%.*s+\n", 11, padding, 11, padding);
+
+    iplc_sim_sd_destroy(sd);
+    iplc_sim_trace_close(trace);
+}
+
+/*
+When -bench-lookup is specified, time cache lookups as the number of sets
+grows. The addresses are random over twice the capacity of the cache, so
+about half of the lookups miss and every set is touched. Generating the
+addresses is part of the timed loop, it is the same work at every size.
+*/
+void run_bench_lookup(int blocksize, int max_index, int assoc, int replacement) {
+
+    FILE* devnull = fopen("/dev/null", "w");
+    sim_config_t config = {0, blocksize, assoc, 0, replacement, 1};
+    const char* padding = "--------------------------------------------------------------------------------";
+    int index;
+    long i;
+
+    if (devnull == NULL) {
+        printf("fopen failed for /dev/null\n");
         exit(-1);
     }
+
+    printf("\n");
+    printf("Cache Lookup Throughput (block size %d, %d-way, %s, %d lookups per size):\n",
+           blocksize, assoc, replacement_ops[replacement].name, BENCH_LOOKUPS);
+    printf("+%.*s+%.*s+%.*s+%.*s+%.*s+\n", 7, padding, 12, padding, 13, padding, 13, padding, 10, padding);
+    printf("| index |     sets   |   metadata  |  Mlookups/s |  hit rate|\n");
+    printf("+%.*s+%.*s+%.*s+%.*s+%.*s+\n", 7, padding, 12, padding, 13, padding, 13, padding, 10, padding);
+
+    for (index = 4; index <= max_index; index += 2) {
+        sim_t* sim;
+        struct timespec start, end;
+        uint64_t rng = 88172645463325252ull;
+        uint64_t lines = (uint64_t) assoc << index;
+        long hits = 0;
+        double seconds;
+
+        config.index = index;
+        sim = iplc_sim_create(&config, devnull);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < BENCH_LOOKUPS; i++) {
+            rng ^= rng >> 12;
+            rng ^= rng << 25;
+            rng ^= rng >> 27;
+            unsigned int line = (unsigned int) (((rng * 0x2545F4914F6CDD1Dull) >> 32) % (2 * lines));
+            hits += iplc_sim_cache_lookup(&sim->cache, line << sim->cache.blockoffsetbits, NULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("| %-5d | %10lu | %8.1f MB | %11.1f | %f |\n", index, 1ul << index,
+               (double) (sim->cache.set_bytes << index) / (1 << 20),
+               BENCH_LOOKUPS / seconds / 1e6, (double) hits / BENCH_LOOKUPS);
+
+        iplc_sim_destroy(sim);
+    }
+
+    printf("+%.*s+%.*s+%.*s+%.*s+%.*s+\n", 7, padding, 12, padding, 13, padding, 13, padding, 10, padding);
+    fclose(devnull);
 }
 
+
+
 /*
 This function pretty prints the menu portion of the performance analysis table.
 */
@@ -730,7 +5154,7 @@ void pretty_print_table_menu(char* title, char menu_sep,
 This function pretty prints the body portion of the performance analysis table.
 Includes pointing out which run had the lowest CPI and cache miss rate.
 */
-void pretty_print_table_body(pa_run_t* results, int m, int w1, int w2, int w3, int w4, int w5, int w6) {
+void pretty_print_table_body(pa_run_t* results, int n, int m, int w1, int w2, int w3, int w4, int w5, int w6) {
 
     char* str;
     const char* padding = "--------------------------------------------------------------------------------";
@@ -744,15 +5168,15 @@ void pretty_print_table_body(pa_run_t* results, int m, int w1, int w2, int w3, i
         w5, padding, '+', 
         w6, padding, '+');
 
-    for (int i = 0; i < 18; i++) {
+    for (int i = 0; i < n; i++) {
 
         str = (m == i) ? " <-- best" : "";
 
         printf("%-2c%-*d%-2c%-*d%-2c%-*d%-2c%-*d%-2c%-*.*f%-2c%-*.*f%c%s\n", 
-            '|', w1-1, results[i].index,
-            ' ', w2-1, results[i].blocksize,
-            ' ', w3-1, results[i].associativity,
-            ' ', w4-1, results[i].branch_pred,
+            '|', w1-1, results[i].config.index,
+            ' ', w2-1, results[i].config.blocksize,
+            ' ', w3-1, results[i].config.assoc,
+            ' ', w4-1, results[i].config.branch_predict_taken,
             '|', w5-1, w5-4, results[i].cpi,
             ' ', w6-1, w6-4, results[i].cmr,
             '|', str);
@@ -766,221 +5190,1754 @@ void pretty_print_table_body(pa_run_t* results, int m, int w1, int w2, int w3, i
 
     }
 
-    printf("%c%.*s%c%.*s%c%.*s%c%.*s%c%.*s%c%.*s%c\n", 
-        '+',
-        w1, padding, '+', 
-        w2, padding, '+', 
-        w3, padding, '+', 
-        w4, padding, '+', 
-        w5, padding, '+', 
-        w6, padding, '+');
+    printf("%c%.*s%c%.*s%c%.*s%c%.*s%c%.*s%c%.*s%c\n", 
+        '+',
+        w1, padding, '+', 
+        w2, padding, '+', 
+        w3, padding, '+', 
+        w4, padding, '+', 
+        w5, padding, '+', 
+        w6, padding, '+');
+
+}
+
+/* pretty prints the performance analysis in a pretty table */
+void pretty_print_table(char* title, char menu_sep, pa_run_t* results, int n, int m,
+                        char* col1, char* col2, char* col3, char* col4, char* col5, char* col6,
+                        int w1, int w2, int w3, int w4, int w5, int w6) {
+
+    pretty_print_table_menu(title, menu_sep,
+                            col1, col2, col3, col4, col5, col6,
+                            w1,w2,w3,w4,w5,w6);
+
+    pretty_print_table_body(results, n, m, w1,w2,w3,w4,w5,w6);
+
+}
+
+/*  Open the trace for a sweep. A text trace is decoded once into a temporary
+    binary trace so that each configuration only replays records. */
+trace_reader_t* run_pa_open_trace(char* tracefile) {
+    trace_reader_t* trace = iplc_sim_trace_open(tracefile);
+    FILE* decoded;
+
+    if (trace == NULL) {
+        printf("fopen failed for %s file\n", tracefile);
+        exit(-1);
+    }
+
+    if (trace->binary)
+        return trace;
+
+    decoded = tmpfile();
+    if (decoded == NULL) {
+        printf("tmpfile failed, replaying %s as text\n", tracefile);
+        return trace;
+    }
+
+    iplc_sim_trace_convert(trace, decoded);
+    iplc_sim_trace_close(trace);
+
+    return iplc_sim_trace_attach(decoded);
+}
+
+/* runs a single configuration of the performance analysis, filling in its results */
+void run_pa_config(pa_run_t* run, trace_reader_t* trace, FILE* out) {
+
+    trace_record_t rec;
+    sim_t* sim = iplc_sim_create(&run->config, out);
+
+    //Replays the decoded instructions
+    iplc_sim_trace_rewind(trace);
+    while(iplc_sim_trace_next(trace, &rec)) {
+
+        iplc_sim_process_record(sim, &rec, &trace->mnemonics);
+        if(sim->dump_pipeline) {
+            //iplc_sim_dump_pipeline(sim);
+        }
+
+    }
+
+    iplc_sim_finalize(sim);
+
+    run->cpi = iplc_sim_cpi(sim);
+    run->cmr = (sim->cache_access == 0)        ? 0 : ((double) sim->cache_miss / (double) sim->cache_access);
+    run->inst_stats = sim->inst_stats;
+    iplc_sim_interval_totals(sim, run->counts);
+    iplc_sim_effective_config(sim, &run->config);
+
+    iplc_sim_destroy(sim);
+}
+
+/*  Work out the settings a run would use without running it, as
+    run_pa_config() leaves them. The simulator made for it traces nothing
+    and writes no intervals, so it doesn't touch the run's files. */
+void run_pa_resolve(pa_run_t* run, FILE* out) {
+    sim_config_t config = run->config;
+    sim_t* sim;
+
+    config.event_sink = EVENT_SINK_NONE;
+    config.event_file = NULL;
+    config.interval = 0;
+    config.hotspots = 0;
+    sim = iplc_sim_create(&config, out);
+    iplc_sim_effective_config(sim, &config);
+    iplc_sim_destroy(sim);
+
+    config.event_sink = run->config.event_sink;
+    config.event_file = run->config.event_file;
+    config.interval = run->config.interval;
+    config.hotspots = run->config.hotspots;
+    run->config = config;
+}
+
+/*  Work shared by the -pa worker threads. Each worker takes the next
+    configuration, runs it on its own simulator and writes the report to a
+    temporary file, which the main thread copies out in configuration order. */
+void run_sweep_log(FILE* log, int i, const pa_run_t* run);
+void run_results_write(run_results_t* results, int i, const pa_run_t* run);
+double run_score(const pa_run_t* run, int objective);
+
+typedef struct pa_pool {
+    pa_run_t* pa_sims;
+    int count;
+    const int* order;  // which configuration each turn runs, NULL runs them in order
+    trace_reader_t* trace;
+    FILE* log;         // a sweep's log, see run_sweep(); NULL for -pa
+    FILE* discard;     // where the reports of a sweep's runs go
+    run_results_t* results;
+
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    int next;       // next configuration to hand out
+    FILE** outputs; // report of each configuration
+    int* done;      // set once a configuration's report is complete
+} pa_pool_t;
+
+void* run_pa_worker(void* arg) {
+
+    pa_pool_t* pool = (pa_pool_t*) arg;
+    trace_reader_t* trace = iplc_sim_trace_clone(pool->trace);
+    int i;
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (i >= pool->count)
+            break;
+        if (pool->order != NULL)
+            i = pool->order[i];
+
+        // a sweep only keeps the results, and keeps them as soon as they are in
+        if (pool->log != NULL) {
+            run_pa_config(&pool->pa_sims[i], trace, pool->discard);
+            pthread_mutex_lock(&pool->lock);
+            run_sweep_log(pool->log, i, &pool->pa_sims[i]);
+            run_results_write(pool->results, i, &pool->pa_sims[i]);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        FILE* out = tmpfile();
+        if (out == NULL) {
+            printf("tmpfile failed for configuration %d\n", i);
+            exit(-1);
+        }
+
+        run_pa_config(&pool->pa_sims[i], trace, out);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->outputs[i] = out;
+        pool->done[i] = 1;
+        run_results_write(pool->results, i, &pool->pa_sims[i]);
+        pthread_cond_broadcast(&pool->finished);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    iplc_sim_trace_close(trace);
+    return NULL;
+}
+
+// Copy a finished report to stdout and throw it away
+void run_pa_merge_output(FILE* out) {
+
+    char buffer[65536];
+    size_t n;
+
+    rewind(out);
+    while ((n = fread(buffer, 1, sizeof(buffer), out)) > 0) {
+        fwrite(buffer, 1, n, stdout);
+    }
+    fclose(out);
+}
+
+/*  Run every configuration on a pool of threads. Reports are printed in
+    configuration order as soon as they are available, so the output is the
+    same as running them one after another. With a sweep log the runs in
+    order are the ones run, their results go to the log and the reports
+    nowhere. */
+void run_pa_parallel(trace_reader_t* trace, pa_run_t* pa_sims, const int* order, int count, int threads,
+                     FILE* log, FILE* discard, run_results_t* results) {
+
+    pa_pool_t pool;
+    pthread_t* workers;
+    int i;
+
+    if (threads > count)
+        threads = count;
+
+    pool.pa_sims = pa_sims;
+    pool.count = count;
+    pool.order = order;
+    pool.trace = trace;
+    pool.log = log;
+    pool.discard = discard;
+    pool.results = results;
+    pool.next = 0;
+    pool.outputs = (FILE**) calloc(count, sizeof(FILE*));
+    pool.done = (int*) calloc(count, sizeof(int));
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.finished, NULL);
+
+    workers = (pthread_t*) malloc(sizeof(pthread_t) * threads);
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, run_pa_worker, &pool) != 0) {
+            printf("pthread_create failed\n");
+            exit(-1);
+        }
+    }
+
+    for (i = 0; i < count && log == NULL; i++) {
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.done[i])
+            pthread_cond_wait(&pool.finished, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+
+        run_pa_merge_output(pool.outputs[i]);
+    }
+
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool.finished);
+    pthread_mutex_destroy(&pool.lock);
+    free(workers);
+    free(pool.done);
+    free(pool.outputs);
+}
+
+/* runs the performance analysis testing and prints the results */
+void run_pa(char* tracefile, const sim_config_t* base, pa_run_t* pa_sims, int p1, int p2, int threads,
+            run_results_t* results) {
+    // p1 and p2 are the precisions of the cpi and cache miss raterespectively
+    // base supplies every setting the sweep doesn't vary
+    // results takes each run as it finishes and the objective the best one is picked by
+
+    trace_reader_t* trace = run_pa_open_trace(tracefile);
+
+    //the nine different simulations, created using arrays
+    //the first and last nine are identical, just with branch predictor configured as take or not taken.
+    int index_inputs    [18] = {7,6,6,6,5,5,5,4,4,  7,6,6,6,5,5,5,4,2};
+    int blocksize_inputs[18] = {1,1,2,4,1,2,4,2,4,  1,1,2,4,1,2,4,2,2};
+    int assoclvl_inputs [18] = {1,2,1,1,4,2,2,4,4,  1,2,1,1,4,2,2,4,2};
+    int brnchpred_inputs[18] = {0,0,0,0,0,0,0,0,0,  1,1,1,1,1,1,1,1,1};
+
+    //keep track of best cache performance
+    int m = 0;
+
+    for (int i = 0; i < 18; i++) {
+        pa_sims[i].config                       = *base;
+        pa_sims[i].config.index                 = index_inputs[i];
+        pa_sims[i].config.blocksize             = blocksize_inputs[i];
+        pa_sims[i].config.assoc                 = assoclvl_inputs[i];
+        pa_sims[i].config.branch_predict_taken  = brnchpred_inputs[i];
+        if (base->event_file != NULL) {
+            snprintf(pa_sims[i].event_file, sizeof(pa_sims[i].event_file), "%s.%d", base->event_file, i);
+            pa_sims[i].config.event_file = pa_sims[i].event_file;
+        }
+        if (base->interval_file != NULL) {
+            snprintf(pa_sims[i].interval_file, sizeof(pa_sims[i].interval_file), "%s.%d", base->interval_file, i);
+            pa_sims[i].config.interval_file = pa_sims[i].interval_file;
+        }
+    }
+
+    if (threads > 1) {
+        run_pa_parallel(trace, pa_sims, NULL, 18, threads, NULL, NULL, results);
+    } else {
+        for (int i = 0; i < 18; i++) {
+            run_pa_config(&pa_sims[i], trace, stdout);
+            run_results_write(results, i, &pa_sims[i]);
+        }
+    }
+
+    for (int i = 0; i < 18; i++) {
+        if (run_score(&pa_sims[i], results->objective) < run_score(&pa_sims[m], results->objective)) {
+            m = i;
+        }
+    }
+
+    iplc_sim_trace_close(trace);
+
+    pretty_print_table("Simulation Performance analysis", ':', pa_sims, 18, m,
+        "cache size", "block size", "associativity", "branch prediction", "CPI", "cache miss rate",
+        3,3,3,4,p1+4,p2+4);
+
+}
+
+/* calcualtes and prints stats in the counts of the parsed instructions */
+void calc_inst_stats(pa_run_t* pa_sims, int n) {
+
+    char* padding = "------------------------";
+    int w1 = 15;
+    int w2 = 10;
+    int w3 = 12;
+
+    inst_stats_t inst_stats = {0,0,0,0,0,0,0};
+
+    //get average results
+    for (int i = 0; i < n; i++) {
+        inst_stats.rtype += pa_sims[i].inst_stats.rtype;
+        inst_stats.sw += pa_sims[i].inst_stats.sw;
+        inst_stats.lw += pa_sims[i].inst_stats.lw;
+        inst_stats.branch += pa_sims[i].inst_stats.branch;
+        inst_stats.jump += pa_sims[i].inst_stats.jump;
+        inst_stats.syscall += pa_sims[i].inst_stats.syscall;
+        inst_stats.nop += pa_sims[i].inst_stats.nop;
+    }
+    inst_stats.rtype /= n;
+    inst_stats.sw /= n;
+    inst_stats.lw /= n;
+    inst_stats.branch /= n;
+    inst_stats.jump /= n;
+    inst_stats.syscall /= n;
+    inst_stats.nop /= n;
+
+
+    int total_count = inst_stats.rtype + inst_stats.sw + 
+                    inst_stats.lw + inst_stats.branch + 
+                    inst_stats.jump + inst_stats.syscall + inst_stats.nop;
+
+
+    printf("\n");
+    printf("%s\n", "Instruction Statistics");
+    printf("%c%.*s%c%.*s%c%.*s%c\n", '+', w1, padding, '+', w2, padding, '+', w3, padding, '+');
+    printf("%c%*s%2c%c%*s%2c%c%*s%2c%c\n", '|', w1-2, "instruction", ' ', '|', w2-2, "count", ' ', '|', w3-2, "percent", ' ', '|');
+    printf("%c%.*s%c%.*s%c%.*s%c\n", '+', w1, padding, '+', w2, padding, '+', w3, padding, '+');
+
+    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "rtype"   , ' ', '|', w2-2, inst_stats.rtype  , ' ', '|', w3-3, 3, (double) 100*inst_stats.rtype/total_count  , '%', '|');
+    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "sw"      , ' ', '|', w2-2, inst_stats.sw     , ' ', '|', w3-3, 3, (double) 100*inst_stats.sw/total_count     , '%', '|');
+    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "lw"      , ' ', '|', w2-2, inst_stats.lw     , ' ', '|', w3-3, 3, (double) 100*inst_stats.lw/total_count     , '%', '|');
+    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "branch"  , ' ', '|', w2-2, inst_stats.branch , ' ', '|', w3-3, 3, (double) 100*inst_stats.branch/total_count , '%', '|');
+    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "jump"    , ' ', '|', w2-2, inst_stats.jump   , ' ', '|', w3-3, 3, (double) 100*inst_stats.jump/total_count   , '%', '|');
+    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "syscall" , ' ', '|', w2-2, inst_stats.syscall, ' ', '|', w3-3, 3, (double) 100*inst_stats.syscall/total_count, '%', '|');
+    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "nop"     , ' ', '|', w2-2, inst_stats.nop    , ' ', '|', w3-3, 3, (double) 100*inst_stats.nop/total_count    , '%', '|');
+
+    printf("%c%.*s%c%.*s%c%.*s%c\n", '+', w1, padding, '+', w2, padding, '+', w3, padding, '+');
+
+}
+
+/*
+When -bench is specified, time the simulator itself over a synthetic trace of
+each pattern: decoding the text trace into records, then simulating them with
+the configuration given on the command line. The patterns only differ in
+their data accesses, which need -dcache to go through a cache. Reports are
+thrown away, so -eventsink none leaves just the simulation. The last row is
+every pattern together, which is the number to watch for regressions.
+*/
+void run_bench(const sim_config_t* config, long records, long footprint, int stride) {
+
+    FILE* devnull = fopen("/dev/null", "w");
+    const char* padding = "--------------------------------------------------------------------------------";
+    double parse_total = 0, sim_total = 0;
+    int pattern;
+
+    if (devnull == NULL) {
+        printf("fopen failed for /dev/null\n");
+        exit(-1);
+    }
+
+    printf("\n");
+    printf("Simulator Throughput (%ld instructions per pattern, %ld byte footprint, %d byte stride):\n",
+           records, footprint, stride);
+    printf("+%.*s+%.*s+%.*s+%.*s+%.*s+\n", 9, padding, 15, padding, 15, padding, 12, padding, 10, padding);
+    printf("| pattern | parse Minst/s |   sim Minst/s |     CPI    | data miss|\n");
+    printf("+%.*s+%.*s+%.*s+%.*s+%.*s+\n", 9, padding, 15, padding, 15, padding, 12, padding, 10, padding);
+
+    for (pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+        FILE* text = tmpfile();
+        FILE* binary = tmpfile();
+        trace_reader_t* trace;
+        trace_record_t rec;
+        struct timespec start, end;
+        sim_t* sim;
+        double parse_seconds, sim_seconds;
+
+        if (text == NULL || binary == NULL) {
+            printf("tmpfile failed for the benchmark traces\n");
+            exit(-1);
+        }
+        iplc_sim_trace_generate(text, pattern, records, footprint, stride);
+
+        trace = iplc_sim_trace_attach(text);
+        trace->profile = config->profile;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        iplc_sim_trace_convert(trace, binary);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        parse_seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        iplc_sim_trace_close(trace);
+
+        trace = iplc_sim_trace_attach(binary);
+        trace->profile = config->profile;
+        sim = iplc_sim_create(config, devnull);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (iplc_sim_trace_next(trace, &rec))
+            iplc_sim_process_record(sim, &rec, &trace->mnemonics);
+        iplc_sim_finalize(sim);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sim_seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        iplc_sim_trace_close(trace);
+
+        parse_total += parse_seconds;
+        sim_total += sim_seconds;
+        printf("| %-7s | %13.2f | %13.2f | %10f | %f |\n", trace_patterns[pattern],
+               records / parse_seconds / 1e6, records / sim_seconds / 1e6, iplc_sim_cpi(sim),
+               sim->data_access ? (double) sim->data_miss / sim->data_access : 0);
+        iplc_sim_destroy(sim);
+    }
+
+    printf("+%.*s+%.*s+%.*s+%.*s+%.*s+\n", 9, padding, 15, padding, 15, padding, 12, padding, 10, padding);
+    printf("| %-7s | %13.2f | %13.2f | %10s | %8s |\n", "all",
+           PATTERN_COUNT * records / parse_total / 1e6, PATTERN_COUNT * records / sim_total / 1e6, "", "");
+    printf("+%.*s+%.*s+%.*s+%.*s+%.*s+\n", 9, padding, 15, padding, 15, padding, 12, padding, 10, padding);
+    fclose(devnull);
+}
 
+//*****Design Space Sweeps*****//
+/*  A sweep file lists the settings to vary, one to a line, with the values
+    to try each one at:
+
+        # comments run to the end of the line
+        index = 4..10           every value from 4 to 10
+        blocksize = 1..16*2     1, 2, 4, 8 and 16
+        memlatency = 10..100:30 10, 40, 70 and 100
+        predictor = bimodal, gshare
+
+    The sweep runs every combination of them, the first setting varying
+    slowest, and takes everything else from the command line, the L1's
+    -index, -blocksize, -assoc and -taken included. */
+typedef struct sweep_param {
+    const char* name;
+    size_t offset;                   // of the setting's int in sim_config_t
+    int (*lookup)(const char* name); // the values of a setting that takes names, NULL if it takes numbers
+} sweep_param_t;
+
+const sweep_param_t sweep_params[] = {
+    {"index",       offsetof(sim_config_t, index),                NULL},
+    {"blocksize",   offsetof(sim_config_t, blocksize),            NULL},
+    {"assoc",       offsetof(sim_config_t, assoc),                NULL},
+    {"taken",       offsetof(sim_config_t, branch_predict_taken), NULL},
+    {"policy",      offsetof(sim_config_t, replacement),          iplc_sim_replacement_policy},
+    {"dcache",      offsetof(sim_config_t, data_cache),           iplc_sim_data_cache_mode},
+    {"dindex",      offsetof(sim_config_t, data_index),           NULL},
+    {"dblocksize",  offsetof(sim_config_t, data_blocksize),       NULL},
+    {"dassoc",      offsetof(sim_config_t, data_assoc),           NULL},
+    {"inclusion",   offsetof(sim_config_t, inclusion),            iplc_sim_inclusion_policy},
+    {"memlatency",  offsetof(sim_config_t, memory_latency),       NULL},
+    {"depth",       offsetof(sim_config_t, depth),                NULL},
+    {"branchstage", offsetof(sim_config_t, branch_stage),         NULL},
+    {"memstage",    offsetof(sim_config_t, mem_stage),            NULL},
+    {"predictor",   offsetof(sim_config_t, predictor),            iplc_sim_predictor_kind},
+    {"predbits",    offsetof(sim_config_t, predictor_bits),       NULL},
+    {"histbits",    offsetof(sim_config_t, history_bits),         NULL},
+    {"btbbits",     offsetof(sim_config_t, btb_bits),             NULL},
+    {"forwarding",  offsetof(sim_config_t, forwarding),           iplc_sim_forwarding_mode},
+    {"width",       offsetof(sim_config_t, width),                NULL},
+    {"memports",    offsetof(sim_config_t, mem_ports),            NULL},
+    {"branchunits", offsetof(sim_config_t, branch_units),         NULL},
+    {"core",        offsetof(sim_config_t, core),                 iplc_sim_core_model},
+    {"rob",         offsetof(sim_config_t, rob_size),             NULL},
+    {"iq",          offsetof(sim_config_t, iq_size),              NULL},
+    {"lsq",         offsetof(sim_config_t, lsq_size),             NULL},
+};
+
+#define SWEEP_PARAMS ((int) (sizeof(sweep_params) / sizeof(sweep_params[0])))
+
+// One varied setting and the values it takes, names[] as the sweep file gave them
+typedef struct sweep_axis {
+    const sweep_param_t* param;
+    int count;
+    int values[SWEEP_MAX_VALUES];
+    char names[SWEEP_MAX_VALUES][SWEEP_VALUE_LEN];
+} sweep_axis_t;
+
+typedef struct sweep {
+    int axes;
+    sweep_axis_t axis[SWEEP_MAX_AXES];
+    long points;   // every combination of the axes' values
+    uint64_t hash; // of the sweep file, which its log has to match
+    uint64_t setup; // ... and of the options and trace it runs with, see run_sweep_setup()
+} sweep_t;
+
+// Fold n bytes into an FNV-1a hash
+static uint64_t run_sweep_fnv(uint64_t hash, const void* data, size_t n) {
+    const uint8_t* bytes = (const uint8_t*) data;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
 }
 
-/* pretty prints the performance analysis in a pretty table */
-void pretty_print_table(char* title, char menu_sep, pa_run_t* results, int m,
-                        char* col1, char* col2, char* col3, char* col4, char* col5, char* col6,
-                        int w1, int w2, int w3, int w4, int w5, int w6) {
+// Cut the blanks off both ends of s
+static char* run_sweep_trim(char* s) {
+    char* end;
 
-    pretty_print_table_menu(title, menu_sep,
-                            col1, col2, col3, col4, col5, col6,
-                            w1,w2,w3,w4,w5,w6);
+    while (iplc_sim_is_blank(*s))
+        s++;
+    for (end = s + strlen(s); end > s && iplc_sim_is_blank(end[-1]); end--)
+        ;
+    *end = '\0';
+    return s;
+}
 
-    pretty_print_table_body(results, m, w1,w2,w3,w4,w5,w6);
+// Add a value to an axis, -1 if it already has as many as it can take
+static int run_sweep_add(sweep_axis_t* axis, long value, const char* name) {
+    if (axis->count == SWEEP_MAX_VALUES || value < INT32_MIN || value > INT32_MAX)
+        return -1;
+    axis->values[axis->count] = (int) value;
+    snprintf(axis->names[axis->count], SWEEP_VALUE_LEN, "%s", name);
+    axis->count++;
+    return 0;
+}
+
+/*  Parse a comma separated list of values into axis: names for a setting
+    that takes them, otherwise numbers and lo..hi ranges stepping by 1, by
+    :step or multiplying by *factor. Returns -1 if it doesn't parse. */
+static int run_sweep_values(sweep_axis_t* axis, char* list) {
+    char name[SWEEP_VALUE_LEN];
+    char *token, *save, *end;
+    long lo, hi, step, value;
+    int n, m;
+    char op;
+
+    for (token = strtok_r(list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+        token = run_sweep_trim(token);
+
+        if (axis->param->lookup != NULL) {
+            value = axis->param->lookup(token);
+            if (value < 0 || run_sweep_add(axis, value, token) < 0)
+                return -1;
+        }
+        else if (sscanf(token, "%ld..%ld%n", &lo, &hi, &n) == 2) {
+            op = ':';
+            step = 1;
+            if (token[n] == ':' || token[n] == '*') {
+                op = token[n];
+                if (sscanf(token + n + 1, "%ld%n", &step, &m) != 1)
+                    return -1;
+                n += 1 + m;
+            }
+            if (token[n] != '\0' || lo > hi || step < 1 || (op == '*' && (step < 2 || lo < 1)))
+                return -1;
 
+            for (value = lo; value <= hi; value = (op == '*') ? value * step : value + step) {
+                snprintf(name, sizeof(name), "%ld", value);
+                if (run_sweep_add(axis, value, name) < 0)
+                    return -1;
+            }
+        }
+        else {
+            value = strtol(token, &end, 0);
+            if (end == token || *end != '\0' || run_sweep_add(axis, value, token) < 0)
+                return -1;
+        }
+    }
+    return axis->count > 0 ? 0 : -1;
 }
 
-/* runs the performance analysis testing and prints the results */
-void run_pa(char* tracefile, pa_run_t* pa_sims, int p1, int p2) {
-    // p1 and p2 are the precisions of the cpi and cache miss raterespectively
+// Read a sweep file, see sweep_param_t for what it looks like
+static sweep_t* run_sweep_parse(const char* path) {
+    FILE* file = fopen(path, "r");
+    sweep_t* sweep = (sweep_t*) calloc(1, sizeof(sweep_t));
+    char *line = NULL, *name, *values;
+    size_t size = 0;
+    ssize_t length;
+    int number = 0, i;
+
+    if (file == NULL) {
+        printf("fopen failed for %s file\n", path);
+        exit(-1);
+    }
+    if (sweep == NULL) {
+        printf("Out of memory reading sweep \n");
+        exit(-1);
+    }
 
-    
+    sweep->points = 1;
+    sweep->hash = 0xcbf29ce484222325ull;
+    while ((length = getline(&line, &size, file)) >= 0) {
+        number++;
+        sweep->hash = run_sweep_fnv(sweep->hash, line, length);
+
+        line[strcspn(line, "#")] = '\0';
+        values = strchr(line, '=');
+        if (values == NULL) {
+            if (*run_sweep_trim(line) == '\0')
+                continue;
+            printf("Line %d of %s doesn't parse \n", number, path);
+            exit(-1);
+        }
+        *values++ = '\0';
+        name = run_sweep_trim(line);
 
-    char buffer[80];
+        for (i = 0; i < SWEEP_PARAMS && strcmp(sweep_params[i].name, name) != 0; i++)
+            ;
+        if (i == SWEEP_PARAMS || sweep->axes == SWEEP_MAX_AXES) {
+            printf("Line %d of %s: %s can't be swept \n", number, path, name);
+            exit(-1);
+        }
 
-    //the nine different simulations, created using arrays
-    //the first and last nine are identical, just with branch predictor configured as take or not taken.
-    int index_inputs    [18] = {7,6,6,6,5,5,5,4,4,  7,6,6,6,5,5,5,4,2};
-    int blocksize_inputs[18] = {1,1,2,4,1,2,4,2,4,  1,1,2,4,1,2,4,2,2};
-    int assoclvl_inputs [18] = {1,2,1,1,4,2,2,4,4,  1,2,1,1,4,2,2,4,2};
-    int brnchpred_inputs[18] = {0,0,0,0,0,0,0,0,0,  1,1,1,1,1,1,1,1,1};
+        sweep->axis[sweep->axes].param = &sweep_params[i];
+        if (run_sweep_values(&sweep->axis[sweep->axes], values) < 0) {
+            printf("Line %d of %s: the values of %s don't parse \n", number, path, name);
+            exit(-1);
+        }
+        sweep->points *= sweep->axis[sweep->axes].count;
+        sweep->axes++;
+        if (sweep->points > SWEEP_MAX_POINTS) {
+            printf("A sweep can't have more than %d points \n", SWEEP_MAX_POINTS);
+            exit(-1);
+        }
+    }
+    free(line);
+    fclose(file);
 
-    double cpi_outputs[18];
-    double cmr_outputs[18];
+    if (sweep->axes == 0) {
+        printf("%s doesn't sweep anything \n", path);
+        exit(-1);
+    }
+    return sweep;
+}
 
-    //keep track of best cache performance
-    int m = 0;
+// Which value of axis a point takes, the last axis varying fastest
+static int run_sweep_value(const sweep_t* sweep, long point, int a) {
+    int b;
 
-    for (int i = 0; i < 18; i++) {
+    for (b = sweep->axes - 1; b > a; b--)
+        point /= sweep->axis[b].count;
+    return (int) (point % sweep->axis[a].count);
+}
 
-    	FILE* trace_file = fopen(tracefile, "r");
+/*  The log of a sweep starts with a line naming the sweep and its setup,
+    then has a line for every point as it finishes: its number, CPI, cache
+    miss rate, instruction counts and the counters of
+    iplc_sim_interval_totals(). Each line is flushed as it is written, so a
+    sweep that is stopped only loses the points it was running. */
+void run_sweep_log(FILE* log, int i, const pa_run_t* run) {
+    const inst_stats_t* stats = &run->inst_stats;
+    int k;
+
+    fprintf(log, "%d %.17g %.17g %d %d %d %d %d %d %d", i, run->cpi, run->cmr, stats->rtype, stats->lw,
+            stats->sw, stats->branch, stats->jump, stats->syscall, stats->nop);
+    for (k = 0; k < INTERVAL_COUNTS; k++)
+        fprintf(log, " %llu", (unsigned long long) run->counts[k]);
+    fprintf(log, "\n");
+    fflush(log);
+}
 
-        pa_sims[i].index            = index_inputs[i];
-        pa_sims[i].blocksize        = blocksize_inputs[i];
-        pa_sims[i].associativity    = assoclvl_inputs[i];
-        pa_sims[i].branch_pred      = brnchpred_inputs[i];
+/*  Hash everything besides the sweep file that the points' results depend
+    on: every setting of base the sweep doesn't vary, as given on the command
+    line, and the trace's path and size. Spelling a default out on the
+    command line changes the hash, which only costs rerunning the points. */
+static uint64_t run_sweep_setup(const sweep_t* sweep, const sim_config_t* base, const char* tracefile) {
+    sim_config_t config = *base;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    struct stat st;
+    int64_t bytes = (stat(tracefile, &st) == 0) ? (int64_t) st.st_size : -1;
+    int a;
+
+    for (a = 0; a < sweep->axes; a++)
+        *(int*) ((char*) &config + sweep->axis[a].param->offset) = 0;
+
+#define SWEEP_SETUP(field) hash = run_sweep_fnv(hash, &config.field, sizeof(config.field))
+    SWEEP_SETUP(index);
+    SWEEP_SETUP(blocksize);
+    SWEEP_SETUP(assoc);
+    SWEEP_SETUP(branch_predict_taken);
+    SWEEP_SETUP(replacement);
+    SWEEP_SETUP(seed);
+    SWEEP_SETUP(data_cache);
+    SWEEP_SETUP(data_index);
+    SWEEP_SETUP(data_blocksize);
+    SWEEP_SETUP(data_assoc);
+    SWEEP_SETUP(levels);
+    SWEEP_SETUP(level);
+    SWEEP_SETUP(inclusion);
+    SWEEP_SETUP(memory_latency);
+    SWEEP_SETUP(depth);
+    SWEEP_SETUP(branch_stage);
+    SWEEP_SETUP(mem_stage);
+    SWEEP_SETUP(predictor);
+    SWEEP_SETUP(predictor_bits);
+    SWEEP_SETUP(history_bits);
+    SWEEP_SETUP(btb_bits);
+    SWEEP_SETUP(forwarding);
+    SWEEP_SETUP(width);
+    SWEEP_SETUP(mem_ports);
+    SWEEP_SETUP(branch_units);
+    SWEEP_SETUP(core);
+    SWEEP_SETUP(rob_size);
+    SWEEP_SETUP(iq_size);
+    SWEEP_SETUP(lsq_size);
+    SWEEP_SETUP(fu_latency);
+    SWEEP_SETUP(sample_period);
+    SWEEP_SETUP(sample_window);
+    SWEEP_SETUP(sample_warmup);
+#undef SWEEP_SETUP
+
+    hash = run_sweep_fnv(hash, tracefile, strlen(tracefile) + 1);
+    return run_sweep_fnv(hash, &bytes, sizeof(bytes));
+}
 
-        branch_predict_taken = brnchpred_inputs[i];
-        iplc_sim_init(index_inputs[i], blocksize_inputs[i], assoclvl_inputs[i]);
+// Read the counters at the end of a log line, -1 if they aren't all there
+static int run_sweep_counts(const char* s, uint64_t* counts) {
+    char* end;
+    int k;
 
-        //Reads the file and parses the instructions
-        while(fgets(buffer, 80, trace_file) != NULL) {
+    for (k = 0; k < INTERVAL_COUNTS; k++) {
+        counts[k] = strtoull(s, &end, 10);
+        if (end == s)
+            return -1;
+        s = end;
+    }
+    return 0;
+}
 
-            iplc_sim_parse_instruction(buffer);
-            if(dump_pipeline) {
-                //iplc_sim_dump_pipeline();
-            }
+/*  Take the results of the points an earlier run of the same sweep logged
+    to path, marking them done. A point whose line doesn't parse, one cut
+    short say, is run again. Returns the log, opened to carry on. */
+static FILE* run_sweep_resume(const sweep_t* sweep, const char* path, pa_run_t* runs, char* done) {
+    FILE* log = fopen(path, "r");
+    char line[1024];
+    long points;
+    unsigned long long hash, setup;
+    int i, n, last = '\n';
+    pa_run_t run;
+    inst_stats_t* stats = &run.inst_stats;
+
+    if (log != NULL) {
+        if (fgets(line, sizeof(line), log) == NULL ||
+            sscanf(line, "# sweep %ld points %llx setup %llx", &points, &hash, &setup) != 3 ||
+            points != sweep->points || hash != sweep->hash) {
+            printf("%s is the log of a different sweep \n", path);
+            exit(-1);
+        }
+        if (setup != sweep->setup) {
+            printf("%s was logged with other options or another trace \n", path);
+            exit(-1);
+        }
 
+        while (fgets(line, sizeof(line), log) != NULL) {
+            // a line without its newline was cut short when the sweep was stopped
+            last = line[strlen(line) - 1];
+            if (last == '\n' &&
+                sscanf(line, "%d %lf %lf %d %d %d %d %d %d %d%n", &i, &run.cpi, &run.cmr, &stats->rtype,
+                       &stats->lw, &stats->sw, &stats->branch, &stats->jump, &stats->syscall, &stats->nop, &n) == 10 &&
+                run_sweep_counts(line + n, run.counts) == 0 && i >= 0 && i < sweep->points) {
+                runs[i].cpi = run.cpi;
+                runs[i].cmr = run.cmr;
+                runs[i].inst_stats = run.inst_stats;
+                memcpy(runs[i].counts, run.counts, sizeof(run.counts));
+                done[i] = 1;
+            }
         }
+        fclose(log);
+
+        log = fopen(path, "a");
+        if (log != NULL && last != '\n')
+            fputc('\n', log);
+    }
+    else {
+        log = fopen(path, "w");
+        if (log != NULL)
+            fprintf(log, "# sweep %ld points %016llx setup %016llx\n", sweep->points,
+                    (unsigned long long) sweep->hash, (unsigned long long) sweep->setup);
+    }
 
-        iplc_sim_finalize();
+    if (log == NULL) {
+        printf("fopen failed for %s file\n", path);
+        exit(-1);
+    }
+    return log;
+}
 
-        cpi_outputs[i] = (instruction_count == 0)   ? 0 : ((double) pipeline_cycles / (double) instruction_count);
-        cmr_outputs[i] = (cache_access == 0)        ? 0 : ((double) cache_miss / (double) cache_access);
+/*  Print a row for every point, the values it gave each setting then its
+    CPI and cache miss rate, pointing out the best one like -pa does. */
+static void run_sweep_print(const sweep_t* sweep, const pa_run_t* runs, int best) {
+    const char* padding = "--------------------------------------------------------------------------------";
+    char number[64];
+    int width[SWEEP_MAX_AXES];
+    int cpi_width = 8, cmr_width = 8;
+    int a, v;
+    long i;
 
-        pa_sims[i].cpi = cpi_outputs[i];
-        pa_sims[i].cmr = cmr_outputs[i];
+    printf("\n");
+    printf("Sweep Performance analysis:\n");
 
-        if (pa_sims[i].cpi + pa_sims[i].cmr < pa_sims[m].cpi + pa_sims[m].cmr) {
-            m = i;
+    for (a = 0; a < sweep->axes; a++) {
+        width[a] = strlen(sweep->axis[a].param->name);
+        for (v = 0; v < sweep->axis[a].count; v++) {
+            if ((int) strlen(sweep->axis[a].names[v]) > width[a])
+                width[a] = strlen(sweep->axis[a].names[v]);
         }
+    }
+    for (i = 0; i < sweep->points; i++) {
+        if (snprintf(number, sizeof(number), "%f", runs[i].cpi) > cpi_width)
+            cpi_width = strlen(number);
+        if (snprintf(number, sizeof(number), "%f", runs[i].cmr) > cmr_width)
+            cmr_width = strlen(number);
+    }
 
-        //reset variables
-
-        instruction_count 			= 0;
-        pipeline_cycles 			= 0;
-        cache_access 				= 0;
-        cache_miss 				= 0;
-        correct_branch_predictions 		= 0;
-        branch_count 				= 0;
+    for (a = 0; a < sweep->axes; a++)
+        printf("+%.*s", width[a] + 2, padding);
+    printf("+%.*s+%.*s+\n", cpi_width + 2, padding, cmr_width + 2, padding);
+    for (a = 0; a < sweep->axes; a++)
+        printf("| %-*s ", width[a], sweep->axis[a].param->name);
+    printf("| %-*s | %-*s |\n", cpi_width, "CPI", cmr_width, "CMR");
+    for (a = 0; a < sweep->axes; a++)
+        printf("+%.*s", width[a] + 2, padding);
+    printf("+%.*s+%.*s+\n", cpi_width + 2, padding, cmr_width + 2, padding);
+
+    for (i = 0; i < sweep->points; i++) {
+        for (a = 0; a < sweep->axes; a++)
+            printf("| %-*s ", width[a], sweep->axis[a].names[run_sweep_value(sweep, i, a)]);
+        printf("| %*f | %*f |%s\n", cpi_width, runs[i].cpi, cmr_width, runs[i].cmr, (i == best) ? " <-- best" : "");
+    }
 
-        //fclose(trace_file);
+    for (a = 0; a < sweep->axes; a++)
+        printf("+%.*s", width[a] + 2, padding);
+    printf("+%.*s+%.*s+\n", cpi_width + 2, padding, cmr_width + 2, padding);
+}
 
+/*  Run every point of the sweep in path over the trace, with base supplying
+    whatever the sweep doesn't vary. Given a log, the points an earlier run
+    of the same sweep logged aren't run again and the rest are logged as
+    they finish. The reports of the runs are thrown away, only the results
+    are kept. */
+void run_sweep(char* tracefile, char* path, char* log_path, const sim_config_t* base, int threads,
+               run_results_t* results) {
+    sweep_t* sweep = run_sweep_parse(path);
+    pa_run_t* runs = (pa_run_t*) calloc(sweep->points, sizeof(pa_run_t));
+    char* done = (char*) calloc(sweep->points, 1);
+    int* order = (int*) malloc(sweep->points * sizeof(int));
+    FILE* discard = fopen("/dev/null", "w");
+    FILE* log;
+    trace_reader_t* trace;
+    int i, a, pending = 0, best = 0;
+
+    if (runs == NULL || done == NULL || order == NULL || discard == NULL) {
+        printf("Out of memory setting up the sweep \n");
+        exit(-1);
     }
 
-    pretty_print_table("Simulation Performance analysis", ':', pa_sims, m,
-        "cache size", "block size", "associativity", "branch prediction", "CPI", "cache miss rate",
-        3,3,3,4,p1+4,p2+4);
+    for (i = 0; i < sweep->points; i++) {
+        runs[i].config = *base;
+        for (a = 0; a < sweep->axes; a++) {
+            const sweep_axis_t* axis = &sweep->axis[a];
 
-}
+            *(int*) ((char*) &runs[i].config + axis->param->offset) = axis->values[run_sweep_value(sweep, i, a)];
+        }
 
-/* calcualtes and prints stats in the counts of the parsed instructions */
-void calc_inst_stats() {
+        // events would only end up in the reports that are thrown away, unless they have a file of their own
+        if (base->event_file != NULL) {
+            snprintf(runs[i].event_file, sizeof(runs[i].event_file), "%s.%d", base->event_file, i);
+            runs[i].config.event_file = runs[i].event_file;
+        }
+        else
+            runs[i].config.event_sink = EVENT_SINK_NONE;
+        if (base->interval_file != NULL) {
+            snprintf(runs[i].interval_file, sizeof(runs[i].interval_file), "%s.%d", base->interval_file, i);
+            runs[i].config.interval_file = runs[i].interval_file;
+        }
+    }
 
-    char* padding = "------------------------";
-    int w1 = 15;
-    int w2 = 10;
-    int w3 = 12;
+    sweep->setup = run_sweep_setup(sweep, base, tracefile);
+    log = (log_path != NULL) ? run_sweep_resume(sweep, log_path, runs, done) : discard;
+    for (i = 0; i < sweep->points; i++) {
+        if (!done[i])
+            order[pending++] = i;
+        else if (results->file != NULL) {
+            // the results start with what the log had, the settings worked out as the run would have
+            run_pa_resolve(&runs[i], discard);
+            run_results_write(results, i, &runs[i]);
+        }
+    }
+    printf("Sweep of %ld points, %d to run \n", sweep->points, pending);
 
-    //get average results
-    inst_stats.rtype /= 18;
-    inst_stats.sw /= 18;
-    inst_stats.lw /= 18;
-    inst_stats.branch /= 18;
-    inst_stats.jump /= 18;
-    inst_stats.syscall /= 18;
-    inst_stats.nop /= 18;
+    if (pending > 0) {
+        trace = run_pa_open_trace(tracefile);
+        if (threads > 1) {
+            run_pa_parallel(trace, runs, order, pending, threads, log, discard, results);
+        } else {
+            for (i = 0; i < pending; i++) {
+                run_pa_config(&runs[order[i]], trace, discard);
+                run_sweep_log(log, order[i], &runs[order[i]]);
+                run_results_write(results, order[i], &runs[order[i]]);
+            }
+        }
+        iplc_sim_trace_close(trace);
+    }
 
+    for (i = 0; i < sweep->points; i++) {
+        if (run_score(&runs[i], results->objective) < run_score(&runs[best], results->objective))
+            best = i;
+    }
 
-    int total_count = inst_stats.rtype + inst_stats.sw + 
-                    inst_stats.lw + inst_stats.branch + 
-                    inst_stats.jump + inst_stats.syscall + inst_stats.nop;
+    run_sweep_print(sweep, runs, best);
+    calc_inst_stats(runs, sweep->points);
 
+    if (log != discard)
+        fclose(log);
+    fclose(discard);
+    free(order);
+    free(done);
+    free(runs);
+    free(sweep);
+}
 
-    printf("\n");
-    printf("%s\n", "Instruction Statistics");
-    printf("%c%.*s%c%.*s%c%.*s%c\n", '+', w1, padding, '+', w2, padding, '+', w3, padding, '+');
-    printf("%c%*s%2c%c%*s%2c%c%*s%2c%c\n", '|', w1-2, "instruction", ' ', '|', w2-2, "count", ' ', '|', w3-2, "percent", ' ', '|');
-    printf("%c%.*s%c%.*s%c%.*s%c\n", '+', w1, padding, '+', w2, padding, '+', w3, padding, '+');
+//*****Result Output*****//
+/*  -results streams a line for every run of -pa or -sweep as it finishes,
+    so whatever drives the sweeps can read them without scraping the
+    tables: the run's number, every setting a sweep can vary as the run
+    used it (see iplc_sim_effective_config()), CPI, the fetch and data miss
+    rates, the run's score by -objective, then every counter of
+    iplc_sim_interval_totals() and the instruction mix. json
+    writes each run as an object on a line of its own, csv a header and a
+    row per run, the columns being the same. Settings that take names are
+    given as their number, counting the names in the order -help lists
+    them. Lines come in the order the runs finish, which with threads isn't
+    the order of the runs. */
+
+// The score of a run by an objective, lower is better for all of them
+double run_score(const pa_run_t* run, int objective) {
+    const uint64_t* c = run->counts;
+
+    switch (objective) {
+        case OBJECTIVE_CPI:
+            return run->cpi;
+        case OBJECTIVE_CMR:
+            return run->cmr;
+        case OBJECTIVE_DMR:
+            return iplc_sim_interval_ratio(c[INTERVAL_DATA_MISSES], c[INTERVAL_DATA_ACCESSES]);
+        case OBJECTIVE_MPKI:
+            return 1000 * iplc_sim_interval_ratio(c[INTERVAL_FETCH_MISSES] + c[INTERVAL_DATA_MISSES],
+                                                  c[INTERVAL_INSTRUCTIONS]);
+        case OBJECTIVE_CYCLES:
+            return (double) c[INTERVAL_CYCLES];
+        case OBJECTIVE_MISPREDICT:
+            return iplc_sim_interval_ratio(c[INTERVAL_MISPREDICTIONS], c[INTERVAL_BRANCHES]);
+        default:
+            return run->cpi + run->cmr;
+    }
+}
 
-    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "rtype"   , ' ', '|', w2-2, inst_stats.rtype  , ' ', '|', w3-3, 3, (double) 100*inst_stats.rtype/total_count  , '%', '|');
-    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "sw"      , ' ', '|', w2-2, inst_stats.sw     , ' ', '|', w3-3, 3, (double) 100*inst_stats.sw/total_count     , '%', '|');
-    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "lw"      , ' ', '|', w2-2, inst_stats.lw     , ' ', '|', w3-3, 3, (double) 100*inst_stats.lw/total_count     , '%', '|');
-    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "branch"  , ' ', '|', w2-2, inst_stats.branch , ' ', '|', w3-3, 3, (double) 100*inst_stats.branch/total_count , '%', '|');
-    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "jump"    , ' ', '|', w2-2, inst_stats.jump   , ' ', '|', w3-3, 3, (double) 100*inst_stats.jump/total_count   , '%', '|');
-    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "syscall" , ' ', '|', w2-2, inst_stats.syscall, ' ', '|', w3-3, 3, (double) 100*inst_stats.syscall/total_count, '%', '|');
-    printf("%c%*s%2c%c%*d%2c%c%*.*f%-3c%c\n", '|', w1-2, "nop"     , ' ', '|', w2-2, inst_stats.nop    , ' ', '|', w3-3, 3, (double) 100*inst_stats.nop/total_count    , '%', '|');
+// One column of a run's line, or its name in the CSV header
+static void run_results_put(const run_results_t* results, int header, int column, const char* name,
+                            const char* value) {
+    if (results->format == RESULT_CSV)
+        fprintf(results->file, "%s%s", column ? "," : "", header ? name : value);
+    else
+        fprintf(results->file, "%s\"%s\":%s", column ? "," : "{", name, value);
+}
 
-    printf("%c%.*s%c%.*s%c%.*s%c\n", '+', w1, padding, '+', w2, padding, '+', w3, padding, '+');
+static void run_results_line(const run_results_t* results, int header, int i, const pa_run_t* run) {
+    const inst_stats_t* stats = &run->inst_stats;
+    const char* mix_names[7] = {"rtype", "lw", "sw", "branch", "jump", "syscall", "nop"};
+    const int mix[7] = {stats->rtype, stats->lw, stats->sw, stats->branch, stats->jump, stats->syscall, stats->nop};
+    const uint64_t* c = run->counts;
+    char value[32];
+    int k, n = 0;
+
+    snprintf(value, sizeof(value), "%d", i);
+    run_results_put(results, header, n++, "run", value);
+    for (k = 0; k < SWEEP_PARAMS; k++) {
+        snprintf(value, sizeof(value), "%d", *(const int*) ((const char*) &run->config + sweep_params[k].offset));
+        run_results_put(results, header, n++, sweep_params[k].name, value);
+    }
+
+    snprintf(value, sizeof(value), "%.17g", run->cpi);
+    run_results_put(results, header, n++, "cpi", value);
+    snprintf(value, sizeof(value), "%.17g", run->cmr);
+    run_results_put(results, header, n++, "fetch_miss_rate", value);
+    snprintf(value, sizeof(value), "%.17g", iplc_sim_interval_ratio(c[INTERVAL_DATA_MISSES], c[INTERVAL_DATA_ACCESSES]));
+    run_results_put(results, header, n++, "data_miss_rate", value);
+    snprintf(value, sizeof(value), "%.17g", run_score(run, results->objective));
+    run_results_put(results, header, n++, "score", value);
+
+    for (k = 0; k < INTERVAL_COUNTS; k++) {
+        snprintf(value, sizeof(value), "%llu", (unsigned long long) c[k]);
+        run_results_put(results, header, n++, interval_columns[k], value);
+    }
+    for (k = 0; k < 7; k++) {
+        snprintf(value, sizeof(value), "%d", mix[k]);
+        run_results_put(results, header, n++, mix_names[k], value);
+    }
+    fprintf(results->file, (results->format == RESULT_CSV) ? "\n" : "}\n");
+}
 
+/*  Write the line of run i, flushed right away so a reader following the
+    file sees it. Nothing without -results. The -pa threads call it under
+    their pool's lock. */
+void run_results_write(run_results_t* results, int i, const pa_run_t* run) {
+    if (results == NULL || results->file == NULL)
+        return;
+
+    if (results->format == RESULT_CSV && results->rows == 0)
+        run_results_line(results, 1, i, run);
+    run_results_line(results, 0, i, run);
+    results->rows++;
+    fflush(results->file);
 }
 
+
+
 /************************************************************************************************/
 /* MAIN Function ********************************************************************************/
 /************************************************************************************************/
 
 //*****Main Function*****//
+/*  Parse a cache level given as index,blocksize,assoc,latency[,policy], the
+    policy defaulting to lru. Returns -1 if it doesn't parse. */
+int iplc_sim_parse_level(const char* arg, cache_level_t* level) {
+    char policy[16] = "lru";
+    int fields = sscanf(arg, "%d,%d,%d,%d,%15s", &level->index, &level->blocksize, &level->assoc,
+                        &level->latency, policy);
+
+    if (fields < 4 || level->index < 1 || level->index > CACHE_MAX_INDEX || level->blocksize < 1 ||
+        level->assoc < 1 || level->latency < 0)
+        return -1;
+
+    level->replacement = iplc_sim_replacement_policy(policy);
+    return level->replacement < 0 ? -1 : 0;
+}
+
+/*  Parse functional unit latencies given as unit=cycles pairs separated by
+    commas, mul=4,div=20 say. Returns -1 if it doesn't parse. */
+int iplc_sim_parse_latencies(const char* arg, int* latency) {
+    char name[16];
+    int cycles, n, i;
+
+    while (*arg) {
+        n = 0;
+        if (sscanf(arg, "%15[^=,]=%d%n", name, &cycles, &n) < 2 || n == 0 || cycles < 1)
+            return -1;
+        for (i = 0; i < FU_COUNT && strcmp(fu_names[i], name) != 0; i++)
+            ;
+        if (i == FU_COUNT || (arg[n] != ',' && arg[n] != '\0'))
+            return -1;
+        latency[i] = cycles;
+        arg += arg[n] ? n + 1 : n;
+    }
+    return 0;
+}
+
+void print_usage(char* prog) {
+    int i;
+
+    printf("Usage: %s [options]                            (interactive)\n", prog);
+    printf("       %s -pa <tracefile> [-j <threads>] [options]\n", prog);
+    printf("       %s -c <text tracefile> <binary tracefile>\n", prog);
+    printf("       %s -sd <tracefile> [-blocksize <n>] [-maxindex <n>] [-maxassoc <n>]\n", prog);
+    printf("       %s -bench-lookup [-blocksize <n>] [-maxindex <n>] [-assoc <n>] [-policy <name>]\n", prog);
+    printf("       %s -gen <pattern> <tracefile> [-records <n>] [-footprint <n>] [-stride <n>]\n", prog);
+    printf("       %s -bench [-records <n>] [-footprint <n>] [-stride <n>] [options]\n", prog);
+    printf("\n");
+    printf("  -pa <tracefile>    run the performance analysis sweep\n");
+    printf("  -j, -threads <n>   run the sweep on n threads, 0 for one per CPU (default 1)\n");
+    printf("  -sweep <file>      with -pa, sweep the settings listed in file rather than the preset\n");
+    printf("                     caches, one name = values line each, values being numbers, names,\n");
+    printf("                     lo..hi, lo..hi:step or lo..hi*factor, comma separated\n");
+    printf("  -sweeplog <path>   log each point of -sweep as it finishes, and skip the points\n");
+    printf("                     already logged there by an earlier run of the same sweep\n");
+    printf("  -results <path>    with -pa, write every counter of each run to path as it finishes\n");
+    printf("  -resultformat <format>\n");
+    printf("                     json (an object per line) or csv (default json)\n");
+    printf("  -objective <name>  what the best run is picked by, the lowest wins (default cpi+cmr):\n");
+    printf("                    ");
+    for (i = 0; i < OBJECTIVE_COUNT; i++)
+        printf(" %s", objectives[i]);
+    printf("\n");
+    printf("  -c <in> <out>      decode a text trace into the binary trace format\n");
+    printf("  -sd <tracefile>    LRU miss rates of every cache size in one pass (stack distance)\n");
+    printf("  -gen <pattern> <out>\n");
+    printf("                     write a synthetic text trace whose loads have the pattern's locality:\n");
+    printf("                    ");
+    for (i = 0; i < PATTERN_COUNT; i++)
+        printf(" %s", trace_patterns[i]);
+    printf("\n");
+    printf("  -bench             simulated instructions per second decoding and simulating a\n");
+    printf("                     synthetic trace of each pattern, with the options given\n");
+    printf("  -records <n>       instructions in a synthetic trace (default %d)\n", BENCH_RECORDS);
+    printf("  -profile           interactively or with -bench, split the time and the hardware counters\n");
+    printf("                     (cycles, instructions, LLC and branch misses) between parsing, cache\n");
+    printf("                     lookup, replacement and the pipeline; counters per phase need rdpmc,\n");
+    printf("                     otherwise they are totals for the run\n");
+    printf("  -footprint <n>     bytes of data a synthetic trace touches, a power of two from 64\n");
+    printf("                     (default %d)\n", GENERATE_FOOTPRINT);
+    printf("  -stride <n>        bytes between the loads of stride and the nodes of chase, a power\n");
+    printf("                     of two from 4 to half the footprint (default %d)\n", GENERATE_STRIDE);
+    printf("  -blocksize <n>     block size for -sd and -bench-lookup, and of L1 for -sweep and -bench\n");
+    printf("                     (default 1)\n");
+    printf("  -maxindex <n>      largest index width for -sd, 1 to 24 (default 10)\n");
+    printf("  -maxassoc <n>      largest associativity for -sd, a power of two (default 16); the fully\n");
+    printf("                     associative caches go up to maxassoc << maxindex lines\n");
+    printf("  -bench-lookup      time cache lookups with 2^4 up to 2^maxindex sets (default 22)\n");
+    printf("  -assoc <n>         associativity for -bench-lookup (default 8), and of L1 for -sweep\n");
+    printf("                     and -bench (default 1)\n");
+    printf("\n");
+    printf("  -index <n>         L1 index bits for -sweep and -bench, 0 to %d (default 10)\n", CACHE_MAX_INDEX);
+    printf("  -taken <0|1>       static prediction for -sweep and -bench, 1 predicts taken (default 0)\n");
+    printf("  -policy <name>     cache replacement policy (default lru):\n");
+    printf("                    ");
+    for (i = 0; i < REPL_COUNT; i++)
+        printf(" %s", replacement_ops[i].name);
+    printf("\n");
+    printf("  -seed <n>          seed for the random and brrip policies (default 1)\n");
+    printf("  -dcache <mode>     lw/sw data accesses: none, split (own L1 data cache) or\n");
+    printf("                     unified (through the instruction cache) (default none)\n");
+    printf("  -dindex <n>        data cache index bits for split (default: the instruction cache's)\n");
+    printf("  -dblocksize <n>    data cache block size for split\n");
+    printf("  -dassoc <n>        data cache associativity for split\n");
+    printf("  -level <i,b,a,lat[,policy]>\n");
+    printf("                     add a cache level below L1 (L2 first, then L3, ...) with index\n");
+    printf("                     bits, block size, associativity, latency in cycles and policy\n");
+    printf("  -inclusion <mode>  how the levels share lines: nine, inclusive or exclusive (default nine)\n");
+    printf("  -memlatency <n>    cycles to main memory (default %d)\n", CACHE_MISS_DELAY);
+    printf("  -depth <n>         pipeline stages, 4 to %d (default %d)\n", MAX_STAGES, PIPELINE_DEPTH);
+    printf("  -branchstage <n>   stage branches resolve in, a mispredict costs that many cycles (default %d)\n", DECODE);
+    printf("  -memstage <n>      stage lw/sw access memory in (default the one before WRITEBACK)\n");
+    printf("  -width <n>         instructions fetched, issued and retired per cycle, 1 to %d (default 1)\n", MAX_WIDTH);
+    printf("  -memports <n>      lw/sw per cycle when wider than 1 (default 1)\n");
+    printf("  -branchunits <n>   branches and jumps per cycle when wider than 1 (default 1)\n");
+    printf("  -forwarding <mode> data hazards: legacy (the original load-use check) or a register\n");
+    printf("                     scoreboard forwarding full (EX->EX and MEM->EX), mem (MEM->EX)\n");
+    printf("                     or none (default legacy)\n");
+    printf("  -predictor <name>  branch predictor, static predicts as asked interactively or by -pa\n");
+    printf("                     (default static):");
+    for (i = 0; i < PRED_COUNT; i++)
+        printf(" %s", predictor_ops[i].name);
+    printf("\n");
+    printf("  -predbits <n>      index bits of the predictor tables (default %d)\n", PREDICTOR_BITS);
+    printf("  -histbits <n>      global and local history bits (default -predbits)\n");
+    printf("  -btbbits <n>       index bits of a branch target buffer, 0 for none (default 0)\n");
+    printf("  -core <model>      inorder (the pipeline) or ooo, an out-of-order core -width wide\n");
+    printf("                     that takes -predictor and the caches but no pipeline options\n");
+    printf("                     (default inorder)\n");
+    printf("  -rob <n>           reorder buffer entries for ooo, 1 to %d (default %d)\n", OOO_MAX_ENTRIES, OOO_ROB_SIZE);
+    printf("  -iq <n>            issue queue entries for ooo, at most -rob (default %d)\n", OOO_IQ_SIZE);
+    printf("  -lsq <n>           load/store queue entries for ooo, at most -rob (default %d)\n", OOO_LSQ_SIZE);
+    printf("  -fulat <list>      functional unit latencies for ooo as unit=cycles pairs (default");
+    for (i = 0; i < FU_COUNT; i++)
+        printf("%s%s=%d", i ? "," : " ", fu_names[i], fu_default_latency[i]);
+    printf(")\n");
+    printf("  -sample <n>        time a sample every n instructions, in between only warm the\n");
+    printf("                     caches and the predictor, and estimate CPI from the samples\n");
+    printf("  -samplewindow <n>  instructions measured in each sample (default %d)\n", SAMPLE_WINDOW);
+    printf("  -samplewarmup <n>  instructions timed ahead of each window but not measured (default %d)\n",
+           SAMPLE_WARMUP);
+    printf("  -hotspots <n>      attribute misses and the cycles they took to instructions, and\n");
+    printf("                     accesses, misses and evictions to L1 sets, and report the n\n");
+    printf("                     instructions that missed most and the n busiest and most evicted sets\n");
+    printf("\n");
+    printf("  -checkpoint <path> interactively, save the simulator and trace position to path\n");
+    printf("                     after -checkpointat records, or at the end of the trace\n");
+    printf("  -checkpointat <n>  records to run before the checkpoint is saved\n");
+    printf("  -restore <path>    interactively, carry on from a checkpoint taken with the same\n");
+    printf("                     trace and shape of caches, pipeline, predictor and core\n");
+    printf("\n");
+    printf("  -events <list>     comma separated events to trace, fetch and data cover hits\n");
+    printf("                     and misses, all is everything (default fetch,data,pipeline):\n");
+    printf("                    ");
+    for (i = 0; i < EVENT_TYPES; i++)
+        printf(" %s", event_names[i]);
+    printf("\n");
+    printf("  -eventsink <sink>  text, binary (event_t records) or none to trace nothing (default text)\n");
+    printf("  -eventfile <path>  write the trace here rather than with the report, -pa adds .<run>\n");
+    printf("\n");
+    printf("  -interval <n>      snapshot the counters every n retired instructions and write what\n");
+    printf("                     happened in each interval to -intervalfile, interactively or with -pa\n");
+    printf("  -intervalfile <path>\n");
+    printf("                     where the intervals go, -pa adds .<run>\n");
+    printf("  -intervalformat <format>\n");
+    printf("                     csv (a line per interval with CPI, miss rates and branch accuracy)\n");
+    printf("                     or binary (interval_t records) (default csv)\n");
+    exit(-1);
+}
+
+// Options past the letters, which have all been given out
+enum long_option {OPT_INTERVAL = 256, OPT_INTERVAL_FILE, OPT_INTERVAL_FORMAT, OPT_RESULTS, OPT_RESULT_FORMAT,
+                  OPT_OBJECTIVE, OPT_INDEX, OPT_TAKEN};
+
 int main(int argc, char* argv[]) {
-    // Arguments: [-pa <tracefile>]
+    // Arguments: [-pa <tracefile> [-j <threads>]] | [-c <text tracefile> <binary tracefile>] | [-sd <tracefile>]
+
+    static struct option long_options[] = {
+        {"pa",        required_argument, NULL, 'p'},
+        {"c",         required_argument, NULL, 'c'},
+        {"threads",   required_argument, NULL, 'j'},
+        {"sweep",     required_argument, NULL, 'f'},
+        {"sweeplog",  required_argument, NULL, 'g'},
+        {"sd",        required_argument, NULL, 's'},
+        {"blocksize", required_argument, NULL, 'b'},
+        {"maxindex",  required_argument, NULL, 'i'},
+        {"maxassoc",  required_argument, NULL, 'a'},
+        {"policy",    required_argument, NULL, 'r'},
+        {"seed",      required_argument, NULL, 'S'},
+        {"dcache",    required_argument, NULL, 'D'},
+        {"dindex",    required_argument, NULL, 'I'},
+        {"dblocksize",required_argument, NULL, 'B'},
+        {"dassoc",    required_argument, NULL, 'A'},
+        {"level",     required_argument, NULL, 'L'},
+        {"inclusion", required_argument, NULL, 'N'},
+        {"memlatency",required_argument, NULL, 'M'},
+        {"bench-lookup", no_argument,    NULL, 'K'},
+        {"bench",     no_argument,       NULL, 'v'},
+        {"profile",   no_argument,       NULL, 'z'},
+        {"hotspots",  required_argument, NULL, 'J'},
+        {"gen",       required_argument, NULL, 'd'},
+        {"records",   required_argument, NULL, 'h'},
+        {"footprint", required_argument, NULL, 'm'},
+        {"stride",    required_argument, NULL, 't'},
+        {"assoc",     required_argument, NULL, 'x'},
+        {"depth",     required_argument, NULL, 'P'},
+        {"branchstage",required_argument, NULL, 'Q'},
+        {"memstage",  required_argument, NULL, 'R'},
+        {"predictor", required_argument, NULL, 'G'},
+        {"predbits",  required_argument, NULL, 'H'},
+        {"histbits",  required_argument, NULL, 'U'},
+        {"btbbits",   required_argument, NULL, 'V'},
+        {"forwarding",required_argument, NULL, 'W'},
+        {"width",     required_argument, NULL, 'X'},
+        {"memports",  required_argument, NULL, 'Y'},
+        {"branchunits",required_argument, NULL, 'Z'},
+        {"core",      required_argument, NULL, 'C'},
+        {"rob",       required_argument, NULL, 'o'},
+        {"iq",        required_argument, NULL, 'q'},
+        {"lsq",       required_argument, NULL, 'l'},
+        {"fulat",     required_argument, NULL, 'u'},
+        {"sample",    required_argument, NULL, 'n'},
+        {"samplewindow",required_argument, NULL, 'w'},
+        {"samplewarmup",required_argument, NULL, 'k'},
+        {"checkpoint",required_argument, NULL, 'O'},
+        {"checkpointat",required_argument, NULL, 'y'},
+        {"restore",   required_argument, NULL, 'e'},
+        {"events",    required_argument, NULL, 'E'},
+        {"eventsink", required_argument, NULL, 'T'},
+        {"eventfile", required_argument, NULL, 'F'},
+        {"interval",  required_argument, NULL, OPT_INTERVAL},
+        {"intervalfile",required_argument, NULL, OPT_INTERVAL_FILE},
+        {"intervalformat",required_argument, NULL, OPT_INTERVAL_FORMAT},
+        {"results",   required_argument, NULL, OPT_RESULTS},
+        {"resultformat",required_argument, NULL, OPT_RESULT_FORMAT},
+        {"objective", required_argument, NULL, OPT_OBJECTIVE},
+        {"index",     required_argument, NULL, OPT_INDEX},
+        {"taken",     required_argument, NULL, OPT_TAKEN},
+        {NULL, 0, NULL, 0}
+    };
 
     char trace_file_name[1024];
-    FILE *trace_file = NULL;
-    char buffer[80];
-    int index = 10;
-    int blocksize = 1;
-    int assoc = 1;
+    trace_reader_t *trace = NULL;
+    trace_record_t rec;
+    sim_t *sim = NULL;
+    sim_config_t config = {10, 1, 1, 0, REPL_LRU, 1};
+
+    char* pa_trace = NULL;
+    char* convert_in = NULL;
+    char* convert_out = NULL;
+    char* sd_trace = NULL;
+    char* checkpoint_file = NULL;
+    char* restore_file = NULL;
+    char* sweep_file = NULL;
+    char* sweep_log = NULL;
+    char* results_file = NULL;
+    run_results_t results = {NULL, RESULT_JSON, OBJECTIVE_CPI_CMR, 0};
+    long checkpoint_at = 0; // 0 saves the checkpoint at the end of the trace
+    long records = 0;
+    int bench_lookup = 0;
+    int bench = 0;
+    int profile = 0;
+    int pattern = 0;
+    char* generate_out = NULL;
+    long bench_records = BENCH_RECORDS;
+    long footprint = GENERATE_FOOTPRINT;
+    int stride = GENERATE_STRIDE;
+    int threads = 1;
+    int max_index = 0; // 0 picks the mode's default
+    int max_assoc = 16;
+    int assoc = 8;
+    int opt;
+
+    /*
+    When there are arguemnts, check that they are the correct arguemnts.
+    */
+
+    while ((opt = getopt_long_only(argc, argv, "+j:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'p':
+                pa_trace = optarg;
+                break;
+            case 'c':
+                // -c takes two file names, the second is the next argument
+                if (optind >= argc)
+                    print_usage(argv[0]);
+                convert_in = optarg;
+                convert_out = argv[optind++];
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                if (threads == 0)
+                    threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+                if (threads < 1)
+                    print_usage(argv[0]);
+                break;
+            case 's':
+                sd_trace = optarg;
+                break;
+            case 'b':
+                config.blocksize = atoi(optarg);
+                if (config.blocksize < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'i':
+                max_index = atoi(optarg);
+                if (max_index < 1 || max_index > 24)
+                    print_usage(argv[0]);
+                break;
+            case 'a':
+                max_assoc = atoi(optarg);
+                if (max_assoc < 1 || (max_assoc & (max_assoc - 1)) != 0)
+                    print_usage(argv[0]);
+                break;
+            case 'r':
+                config.replacement = iplc_sim_replacement_policy(optarg);
+                if (config.replacement < 0)
+                    print_usage(argv[0]);
+                break;
+            case 'S':
+                config.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'K':
+                bench_lookup = 1;
+                break;
+            case 'v':
+                bench = 1;
+                break;
+            case 'z':
+                profile = 1;
+                break;
+            case 'J':
+                config.hotspots = atoi(optarg);
+                if (config.hotspots < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'd':
+                // -gen takes a pattern and a file name, the second is the next argument
+                pattern = iplc_sim_trace_pattern(optarg);
+                if (pattern < 0 || optind >= argc)
+                    print_usage(argv[0]);
+                generate_out = argv[optind++];
+                break;
+            case 'h':
+                bench_records = atol(optarg);
+                if (bench_records < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'm':
+                footprint = atol(optarg);
+                if (footprint < 64 || footprint > (1l << 30) || (footprint & (footprint - 1)))
+                    print_usage(argv[0]);
+                break;
+            case 't':
+                stride = atoi(optarg);
+                if (stride < 4 || (stride & (stride - 1)))
+                    print_usage(argv[0]);
+                break;
+            case 'x':
+                // -bench-lookup's associativity, and the L1's everywhere the prompt doesn't ask for it
+                assoc = config.assoc = atoi(optarg);
+                if (assoc < 1 || assoc > CACHE_MAX_ASSOC)
+                    print_usage(argv[0]);
+                break;
+            case 'D':
+                config.data_cache = iplc_sim_data_cache_mode(optarg);
+                if (config.data_cache < 0)
+                    print_usage(argv[0]);
+                break;
+            case 'I':
+                config.data_index = atoi(optarg);
+                if (config.data_index < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'B':
+                config.data_blocksize = atoi(optarg);
+                if (config.data_blocksize < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'A':
+                config.data_assoc = atoi(optarg);
+                if (config.data_assoc < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'L':
+                // Each -level adds the next level down: index,blocksize,assoc,latency[,policy]
+                if (config.levels == CACHE_MAX_LEVELS - 1)
+                    print_usage(argv[0]);
+                if (iplc_sim_parse_level(optarg, &config.level[config.levels]) < 0)
+                    print_usage(argv[0]);
+                config.levels++;
+                break;
+            case 'N':
+                config.inclusion = iplc_sim_inclusion_policy(optarg);
+                if (config.inclusion < 0)
+                    print_usage(argv[0]);
+                break;
+            case 'M':
+                config.memory_latency = atoi(optarg);
+                if (config.memory_latency < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'P':
+                config.depth = atoi(optarg);
+                if (config.depth < 4 || config.depth > MAX_STAGES)
+                    print_usage(argv[0]);
+                break;
+            case 'Q':
+                config.branch_stage = atoi(optarg);
+                if (config.branch_stage < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'R':
+                config.mem_stage = atoi(optarg);
+                if (config.mem_stage < 2)
+                    print_usage(argv[0]);
+                break;
+            case 'G':
+                config.predictor = iplc_sim_predictor_kind(optarg);
+                if (config.predictor < 0)
+                    print_usage(argv[0]);
+                break;
+            case 'H':
+                config.predictor_bits = atoi(optarg);
+                if (config.predictor_bits < 1 || config.predictor_bits > PREDICTOR_MAX_BITS)
+                    print_usage(argv[0]);
+                break;
+            case 'U':
+                config.history_bits = atoi(optarg);
+                if (config.history_bits < 1 || config.history_bits > PREDICTOR_MAX_BITS)
+                    print_usage(argv[0]);
+                break;
+            case 'V':
+                config.btb_bits = atoi(optarg);
+                if (config.btb_bits < 0 || config.btb_bits > PREDICTOR_MAX_BITS)
+                    print_usage(argv[0]);
+                break;
+            case 'X':
+                config.width = atoi(optarg);
+                if (config.width < 1 || config.width > MAX_WIDTH)
+                    print_usage(argv[0]);
+                break;
+            case 'Y':
+                config.mem_ports = atoi(optarg);
+                if (config.mem_ports < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'Z':
+                config.branch_units = atoi(optarg);
+                if (config.branch_units < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'W':
+                config.forwarding = iplc_sim_forwarding_mode(optarg);
+                if (config.forwarding < 0)
+                    print_usage(argv[0]);
+                break;
+            case 'C':
+                config.core = iplc_sim_core_model(optarg);
+                if (config.core < 0)
+                    print_usage(argv[0]);
+                break;
+            case 'o':
+                config.rob_size = atoi(optarg);
+                if (config.rob_size < 1 || config.rob_size > OOO_MAX_ENTRIES)
+                    print_usage(argv[0]);
+                break;
+            case 'q':
+                config.iq_size = atoi(optarg);
+                if (config.iq_size < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'l':
+                config.lsq_size = atoi(optarg);
+                if (config.lsq_size < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'u':
+                if (iplc_sim_parse_latencies(optarg, config.fu_latency) < 0)
+                    print_usage(argv[0]);
+                break;
+            case 'n':
+                config.sample_period = atol(optarg);
+                if (config.sample_period < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'w':
+                config.sample_window = atol(optarg);
+                if (config.sample_window < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'k':
+                config.sample_warmup = atol(optarg);
+                if (config.sample_warmup < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'O':
+                checkpoint_file = optarg;
+                break;
+            case 'y':
+                checkpoint_at = atol(optarg);
+                if (checkpoint_at < 1)
+                    print_usage(argv[0]);
+                break;
+            case 'e':
+                restore_file = optarg;
+                break;
+            case 'f':
+                sweep_file = optarg;
+                break;
+            case 'g':
+                sweep_log = optarg;
+                break;
+            case 'E':
+                config.events = iplc_sim_event_mask(optarg);
+                if (config.events == 0)
+                    print_usage(argv[0]);
+                break;
+            case 'T':
+                config.event_sink = iplc_sim_event_sink(optarg);
+                if (config.event_sink < 0)
+                    print_usage(argv[0]);
+                break;
+            case 'F':
+                config.event_file = optarg;
+                break;
+            case OPT_INTERVAL:
+                config.interval = atol(optarg);
+                if (config.interval < 1)
+                    print_usage(argv[0]);
+                break;
+            case OPT_INTERVAL_FILE:
+                config.interval_file = optarg;
+                break;
+            case OPT_INTERVAL_FORMAT:
+                config.interval_format = iplc_sim_interval_format(optarg);
+                if (config.interval_format < 0)
+                    print_usage(argv[0]);
+                break;
+            case OPT_RESULTS:
+                results_file = optarg;
+                break;
+            case OPT_RESULT_FORMAT:
+                results.format = iplc_sim_result_format(optarg);
+                if (results.format < 0)
+                    print_usage(argv[0]);
+                break;
+            case OPT_OBJECTIVE:
+                results.objective = iplc_sim_objective(optarg);
+                if (results.objective < 0)
+                    print_usage(argv[0]);
+                break;
+            case OPT_INDEX:
+                config.index = atoi(optarg);
+                if (config.index < 0 || config.index > CACHE_MAX_INDEX)
+                    print_usage(argv[0]);
+                break;
+            case OPT_TAKEN:
+                config.branch_predict_taken = atoi(optarg);
+                if (config.branch_predict_taken != 0 && config.branch_predict_taken != 1)
+                    print_usage(argv[0]);
+                break;
+            default:
+                print_usage(argv[0]);
+        }
+    }
+
+    if (optind < argc || (pa_trace != NULL) + (convert_in != NULL) + (sd_trace != NULL) + bench_lookup +
+                         (generate_out != NULL) + bench > 1)
+        print_usage(argv[0]);
+
+    // checkpoints are taken and restored interactively
+    if ((checkpoint_file != NULL || restore_file != NULL) &&
+        (pa_trace != NULL || convert_in != NULL || sd_trace != NULL || bench_lookup || generate_out != NULL || bench))
+        print_usage(argv[0]);
+
+    if (stride > footprint / 2)
+        print_usage(argv[0]);
+
+    // the profile follows one simulator on the main thread, interactively or through -bench
+    if (profile && (pa_trace != NULL || convert_in != NULL || sd_trace != NULL || bench_lookup || generate_out != NULL))
+        print_usage(argv[0]);
+    if (profile)
+        config.profile = iplc_sim_profile_start();
+
+    // a sweep file takes the place of the preset -pa caches
+    if ((sweep_file == NULL && sweep_log != NULL) || (sweep_file != NULL && pa_trace == NULL))
+        print_usage(argv[0]);
+
+    // ... and so do the results and the objective
+    if ((results_file != NULL || results.objective != OBJECTIVE_CPI_CMR) && pa_trace == NULL)
+        print_usage(argv[0]);
+
+    if (config.event_sink == EVENT_SINK_BINARY && config.event_file == NULL) {
+        printf("-eventsink binary needs -eventfile \n");
+        exit(-1);
+    }
+
+    // intervals follow the simulations run interactively, by -pa or by -sweep
+    if (config.interval && (convert_in != NULL || sd_trace != NULL || bench_lookup || generate_out != NULL || bench))
+        print_usage(argv[0]);
+    if (config.interval && config.interval_file == NULL) {
+        printf("-interval needs -intervalfile \n");
+        exit(-1);
+    }
 
-    if (argc == 1) {
-        // When no other arguments are given, default to asking the user for the input information.
+    if (pa_trace == NULL && convert_in == NULL && sd_trace == NULL && !bench_lookup && generate_out == NULL && !bench) {
+        // When no mode is given, default to asking the user for the input information.
 
         printf("Please enter the tracefile: ");
         scanf("%s", trace_file_name);
         
-        trace_file = fopen(trace_file_name, "r");
+        trace = iplc_sim_trace_open(trace_file_name);
         
-        if (trace_file == NULL) {
+        if (trace == NULL) {
             printf("fopen failed for %s file\n", trace_file_name);
             exit(-1);
         }
+        trace->profile = config.profile;
         
         printf("Enter Cache Size (index), Blocksize and Level of Assoc \n");
-        scanf( "%d %d %d", &index, &blocksize, &assoc );
+        scanf( "%d %d %d", &config.index, &config.blocksize, &config.assoc );
         
         printf("Enter Branch Prediction: 0 (NOT taken), 1 (TAKEN): ");
-        scanf("%d", &branch_predict_taken);
+        scanf("%d", &config.branch_predict_taken);
         
-        iplc_sim_init(index, blocksize, assoc);
+        sim = iplc_sim_create(&config, stdout);
+        if (restore_file != NULL)
+            iplc_sim_checkpoint_restore(sim, trace, restore_file);
         
-        while (fgets(buffer, 80, trace_file) != NULL) {
-            iplc_sim_parse_instruction(buffer);
-            if (dump_pipeline)
-                iplc_sim_dump_pipeline();
+        while (iplc_sim_trace_next(trace, &rec)) {
+            iplc_sim_process_record(sim, &rec, &trace->mnemonics);
+            if (sim->dump_pipeline)
+                iplc_sim_dump_pipeline(sim);
+            if (checkpoint_file != NULL && ++records == checkpoint_at)
+                iplc_sim_checkpoint_save(sim, trace, checkpoint_file);
         }
+        if (checkpoint_file != NULL && checkpoint_at == 0)
+            iplc_sim_checkpoint_save(sim, trace, checkpoint_file);
         
-        iplc_sim_finalize();
+        iplc_sim_finalize(sim);
+        iplc_sim_destroy(sim);
+        iplc_sim_trace_close(trace);
+        if (profile)
+            iplc_sim_profile_report(config.profile, stdout);
+
+    } else if (sd_trace != NULL) {
 
-    } else {
         /*
-        When there are arguemnts, check that they are the correct arguemnts.
+        When -sd is specified, compute the LRU miss rate of every index/assoc
+        combination at one block size from a single pass over the trace.
         */
 
-        if (argc == 3) {
-            if (strcmp(argv[1],"-pa") == 0) {
+        run_sd(sd_trace, config.blocksize, max_index ? max_index : 10, max_assoc);
+    } else if (bench_lookup) {
 
-                /*
-                When -pa is specified, run the performance analysis on pre-set input variables.
-                The output is then summarized for the simulation.
-                */
+        /*
+        When -bench-lookup is specified, measure how fast the cache lookup is
+        from a few sets up to caches of millions of lines.
+        */
 
-                trace_file = fopen(argv[2], "r");
+        run_bench_lookup(config.blocksize, max_index ? max_index : 22, assoc, config.replacement);
+    } else if (generate_out != NULL) {
 
-                if (trace_file == NULL) {
-                    //todo: problems
-                } else {
-                    // all good
-                }
+        /*
+        When -gen is specified, write a synthetic trace with the locality of a
+        pattern, to try a configuration on or to benchmark with.
+        */
+
+        FILE* out = fopen(generate_out, "w");
+
+        if (out == NULL) {
+            printf("fopen failed for %s file\n", generate_out);
+            exit(-1);
+        }
+        iplc_sim_trace_generate(out, pattern, bench_records, footprint, stride);
+        fclose(out);
+    } else if (bench) {
+
+        /*
+        When -bench is specified, measure how fast the simulator runs the
+        configuration given over synthetic traces of every pattern.
+        */
+
+        run_bench(&config, bench_records, footprint, stride);
+        if (profile)
+            iplc_sim_profile_report(config.profile, stdout);
+    } else if (pa_trace != NULL) {
 
-                pa_run_t pa_sims[18];
+        /*
+        When -pa is specified, run the performance analysis on pre-set input variables,
+        or on those of -sweep. The output is then summarized for the simulation.
+        */
 
-                run_pa(argv[2], pa_sims, 6, 6);
+        pa_run_t pa_sims[18];
 
-                calc_inst_stats();
-            } else {
-                //todo: problems
+        if (results_file != NULL) {
+            results.file = fopen(results_file, "w");
+            if (results.file == NULL) {
+                printf("fopen failed for %s file\n", results_file);
+                exit(-1);
             }
+        }
+
+        if (sweep_file != NULL) {
+            run_sweep(pa_trace, sweep_file, sweep_log, &config, threads, &results);
         } else {
-            //todo: problems
+            run_pa(pa_trace, &config, pa_sims, 6, 6, threads, &results);
+
+            calc_inst_stats(pa_sims, 18);
+        }
+        if (results.file != NULL)
+            fclose(results.file);
+    } else {
+
+        /*
+        When -c is specified, decode a text trace into the binary trace format.
+        Both -pa and the interactive mode accept either format.
+        */
+
+        FILE* out = fopen(convert_out, "wb");
+
+        trace = iplc_sim_trace_open(convert_in);
+        if (trace == NULL || out == NULL) {
+            printf("fopen failed for %s file\n", (trace == NULL) ? convert_in : convert_out);
+            exit(-1);
         }
+
+        printf("Wrote %ld records to %s \n", iplc_sim_trace_convert(trace, out), convert_out);
+
+        fclose(out);
+        iplc_sim_trace_close(trace);
     }
     return 0;
 }